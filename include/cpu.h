@@ -10,8 +10,12 @@
 #define _CPU_H_
 
 #include <stdint.h>
+#include <stddef.h>
 #include "vm.h"
 
 int c8_cpu_cycle(c8_vm_t* vm);
+int c8_cpu_exec_instr(c8_vm_t* vm, uint16_t instr);
+void c8_cpu_select(c8_vm_t* vm);
+int c8_cpu_disasm(uint16_t instr, char* buf, size_t len);
 
 #endif
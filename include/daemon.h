@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef _DAEMON_H_
+#define _DAEMON_H_
+
+#include <stdint.h>
+#include "vm.h"
+
+#define C8_JOB_MAGIC 0x424f4a38
+#define C8_JOB_MAX_INPUTS (1 << 20)
+/* an hour of emulated time, so one job can't hold a worker forever */
+#define C8_JOB_MAX_FRAMES (60 * 60 * 60)
+
+/* quirks holds the quirks to use instead of guessing them from the ROM */
+#define C8_JOB_QUIRKS 0x01
+/* keep running the connection's previous VM instead of booting the ROM */
+#define C8_JOB_RESUME 0x02
+
+/*
+ * A job is this header, rom_size bytes of ROM and input_count keypad
+ * masks. Frame i is run with inputs[i], the last mask is held for the
+ * remaining frames. rom_size 0 reuses the connection's previous ROM.
+ */
+typedef struct __attribute__((packed)) {
+	uint32_t magic;
+	uint16_t rom_size;
+	uint8_t quirks;
+	uint8_t flags;
+	uint32_t seed;
+	uint32_t frames;
+	uint32_t input_count;
+} c8_job_t;
+
+typedef struct __attribute__((packed)) {
+	uint32_t magic;
+	int32_t status;
+	uint32_t frames;
+	uint8_t run;
+	uint8_t registers[REGISTERS_COUNT];
+	uint16_t immediate;
+	uint16_t program_counter;
+	uint8_t stack_counter;
+	uint8_t delay_timer;
+	uint8_t sound_timer;
+	uint16_t stack[STACK_SIZE];
+	uint8_t frame_buffer[SCREEN_HEIGHT][SCREEN_FB_WIDTH];
+} c8_job_result_t;
+
+int c8_daemon_run(const char* path, int workers, int window);
+
+#endif
@@ -0,0 +1,20 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef _DEBUG_H_
+#define _DEBUG_H_
+
+#include <stdint.h>
+#include "vm.h"
+
+int c8_debug_armed();
+void c8_debug_break(c8_vm_t* vm);
+void c8_debug_check(c8_vm_t* vm);
+void c8_debug_watch(c8_vm_t* vm, uint16_t addr, uint8_t old_val, uint8_t new_val);
+
+#endif
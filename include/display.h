@@ -13,6 +13,7 @@
 #include "vm.h"
 
 void c8_display_init();
+void c8_display_convert(c8_vm_t* vm, uint32_t* pixels, int pitch);
 int c8_display_draw(c8_vm_t* vm);
 void c8_display_destroy();
 
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef _EXPLORE_H_
+#define _EXPLORE_H_
+
+#include <stdint.h>
+#include "vm.h"
+
+#define C8_EXPLORE_INPUTS 17
+
+/*
+ * Called from the worker threads, so it must be safe to call
+ * concurrently. Higher is better.
+ */
+typedef int (*c8_explore_score_fn)(const c8_vm_t* vm, void* user);
+
+typedef struct {
+	int frames_per_step;
+	int max_depth;
+	uint32_t max_nodes;
+	int threads;
+	int best_first;
+	int goal;
+	uint8_t table_bits;
+	c8_explore_score_fn score;
+	void* user;
+} c8_explore_opts_t;
+
+typedef struct {
+	int found;
+	int score;
+	int depth;
+	uint16_t* inputs;
+	uint64_t expanded;
+	uint64_t duplicates;
+} c8_explore_result_t;
+
+uint64_t c8_explore_hash(const c8_vm_t* vm);
+int c8_explore(const c8_vm_t* root, const c8_explore_opts_t* opts, c8_explore_result_t* result);
+void c8_explore_result_free(c8_explore_result_t* result);
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef _LIBRARY_H_
+#define _LIBRARY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include "vm.h"
+
+#define C8_ROM_MAX_SIZE (MEMORY_SIZE - PROGRAMM_LOAD_ADDR)
+#define C8_ROM_NAME_MAX 256
+
+#define C8_PLATFORM_CHIP8 0
+#define C8_PLATFORM_SCHIP 1
+#define C8_PLATFORM_XOCHIP 2
+
+typedef struct {
+	const uint8_t* data;
+	size_t size;
+} c8_rom_t;
+
+typedef struct {
+	uint64_t hash;
+	uint32_t size;
+	int64_t mtime;
+	uint8_t platform;
+	uint8_t quirks;
+	char name[C8_ROM_NAME_MAX];
+} c8_rom_entry_t;
+
+typedef struct {
+	char dir[PATH_MAX];
+	c8_rom_entry_t* entries;
+	int count;
+	int capacity;
+} c8_library_t;
+
+int c8_rom_map(const char* path, c8_rom_t* rom);
+void c8_rom_unmap(c8_rom_t* rom);
+uint64_t c8_rom_hash(const uint8_t* data, size_t size);
+void c8_rom_detect(const uint8_t* data, size_t size, uint8_t* platform, uint8_t* quirks);
+const char* c8_platform_name(uint8_t platform);
+
+int c8_library_open(c8_library_t* lib, const char* dir);
+int c8_library_find(c8_library_t* lib, const char* name, c8_rom_entry_t** entry);
+int c8_library_path(c8_library_t* lib, c8_rom_entry_t* entry, char* path, size_t len);
+void c8_library_close(c8_library_t* lib);
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef _MEM_H_
+#define _MEM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "vm.h"
+
+#define C8_PAGE_OFFSET_MASK (C8_PAGE_SIZE - 1)
+
+int c8_mem_image_create(c8_image_t* image, const uint8_t* rom, size_t size);
+void c8_mem_image_destroy(c8_image_t* image);
+void c8_mem_attach(c8_vm_t* vm, const c8_image_t* image);
+void c8_mem_clone(c8_vm_t* dst, const c8_vm_t* src);
+void c8_mem_release(c8_vm_t* vm);
+c8_page_t* c8_mem_unshare(c8_vm_t* vm, uint16_t index);
+uint64_t c8_mem_hash_bytes(const void* data, size_t len, uint64_t seed);
+uint64_t c8_mem_hash(const c8_vm_t* vm);
+
+static inline uint8_t c8_mem_read(const c8_vm_t* vm, uint16_t addr) {
+	addr &= MEMORY_SIZE - 1;
+
+	return vm->c8_pages[addr >> C8_PAGE_SHIFT]->c8_data[addr & C8_PAGE_OFFSET_MASK];
+}
+
+/*
+ * A page referenced by anyone else is copied before the first write. Only
+ * private pages are written in place, so only their cached hash can go
+ * stale.
+ */
+static inline void c8_mem_write(c8_vm_t* vm, uint16_t addr, uint8_t val) {
+	addr &= MEMORY_SIZE - 1;
+	c8_page_t* page = vm->c8_pages[addr >> C8_PAGE_SHIFT];
+
+	if (__atomic_load_n(&page->c8_refs, __ATOMIC_ACQUIRE) != 1 && (page = c8_mem_unshare(vm, addr >> C8_PAGE_SHIFT)) == NULL) {
+		return;
+	}
+
+	page->c8_data[addr & C8_PAGE_OFFSET_MASK] = val;
+	__atomic_store_n(&page->c8_hash, 0, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdint.h>
+#include "vm.h"
+
+struct SDL_Renderer;
+
+int c8_metrics_init(const char* dest, int json, int overlay, int instances);
+int c8_metrics_enabled();
+void c8_metrics_frame(uint32_t instructions, uint32_t cycles, int dropped);
+void c8_metrics_present(uint64_t begin, uint64_t end);
+void c8_metrics_input(uint32_t timestamp);
+void c8_metrics_audio(uint32_t queued_ms, int underrun);
+void c8_metrics_toggle_overlay();
+void c8_metrics_overlay(struct SDL_Renderer* renderer);
+void c8_metrics_destroy();
+
+#endif
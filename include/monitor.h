@@ -0,0 +1,19 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef _MONITOR_H_
+#define _MONITOR_H_
+
+#include <stdint.h>
+#include "vm.h"
+
+int c8_monitor_init(int count);
+int c8_monitor_draw(c8_vm_t* vms, int count);
+void c8_monitor_destroy();
+
+#endif
@@ -0,0 +1,19 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef _QUIRKS_H_
+#define _QUIRKS_H_
+
+#include <stdint.h>
+#include "vm.h"
+
+int c8_quirks_parse(const char* names, uint8_t* quirks);
+int c8_quirks_load_profile(const char* rom_path, uint8_t* quirks);
+const char* c8_quirks_name(uint8_t quirk);
+
+#endif
@@ -12,7 +12,8 @@
 #include <stdint.h>
 #include "vm.h"
 
-int c8_timer_update(c8_vm_t* vm);
 void c8_timer_init();
+int c8_timer_tick(c8_vm_t* vm);
+int c8_timer_wait_frame();
 
 #endif
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include "vm.h"
+
+#define C8_TRACE_MAGIC "C8TRACE"
+#define C8_TRACE_VERSION 1
+#define C8_TRACE_MAX_WRITES REGISTERS_COUNT
+
+typedef struct __attribute__((packed)) {
+	char magic[8];
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t reserved;
+} c8_trace_header_t;
+
+/*
+ * One executed instruction. Registers and I are the values after it ran;
+ * reg_mask has a bit set for every register it changed. Memory writes
+ * are contiguous for every opcode that writes (FX33, FX55).
+ */
+typedef struct __attribute__((packed)) {
+	uint32_t index;
+	uint16_t pc;
+	uint16_t opcode;
+	uint16_t immediate;
+	uint16_t reg_mask;
+	uint16_t mem_addr;
+	uint8_t mem_len;
+	uint8_t stack_counter;
+	uint8_t registers[REGISTERS_COUNT];
+	uint8_t mem[C8_TRACE_MAX_WRITES];
+} c8_trace_record_t;
+
+int c8_trace_open(const char* path, uint32_t ring_records);
+int c8_trace_active();
+void c8_trace_begin(c8_vm_t* vm);
+void c8_trace_write(uint16_t addr, uint8_t val);
+void c8_trace_end(c8_vm_t* vm);
+int c8_trace_close();
+
+#endif
@@ -17,16 +17,59 @@
 #define STACK_SIZE 16
 #define FRAME_BUFFER_SIZE 256
 #define FONT_ADDR 80
+#define FONT_ARR_LENGTH 80
 #define SCREEN_FB_WIDTH 8
 #define SCREEN_HEIGHT 32
 #define SCREEN_WIDTH 64
+#define PROGRAMM_LOAD_ADDR 512
+#define FRAMES_PER_SECOND 60
+
+/*
+ * COSMAC VIP machine cycles (8 clocks at 1.7609 MHz) per 60 Hz frame,
+ * less what video DMA, one cycle per byte on each of the 4 scan lines a
+ * row is shown on, and the display interrupt take away from CHIP-8.
+ */
+#define C8_VIP_CYCLES_PER_FRAME 3668
+#define C8_VIP_DMA_CYCLES (SCREEN_HEIGHT * 4 * SCREEN_FB_WIDTH)
+#define C8_VIP_INTERRUPT_CYCLES 46
+#define C8_FRAME_CYCLES (C8_VIP_CYCLES_PER_FRAME - C8_VIP_DMA_CYCLES - C8_VIP_INTERRUPT_CYCLES)
+#define C8_PAGE_SHIFT 8
+#define C8_PAGE_SIZE (1 << C8_PAGE_SHIFT)
+#define C8_PAGE_COUNT (MEMORY_SIZE >> C8_PAGE_SHIFT)
+#define C8_CACHE_LINE 64
+
+#define C8_QUIRK_SHIFT 0x01
+#define C8_QUIRK_LOAD 0x02
+#define C8_QUIRK_CLIP 0x04
+#define C8_QUIRK_VF_RESET 0x08
+#define C8_QUIRK_JUMP 0x10
+#define C8_QUIRK_VBLANK 0x20
+#define C8_QUIRK_COUNT 6
+#define C8_QUIRK_MASK ((1 << C8_QUIRK_COUNT) - 1)
+
+/*
+ * Memory is split into reference counted pages. Instances running the same
+ * ROM share its pages until they write to one, see mem.c. c8_hash caches
+ * the content hash, 0 if not computed yet. The data starts on its own
+ * cache line so refcount traffic doesn't evict it from other cores.
+ */
+typedef struct {
+	uint32_t c8_refs;
+	uint64_t c8_hash;
+	uint8_t c8_data[C8_PAGE_SIZE] __attribute__((aligned(C8_CACHE_LINE)));
+} c8_page_t;
 
 typedef struct {
+	c8_page_t* c8_pages[C8_PAGE_COUNT];
+} c8_image_t;
+
+typedef struct c8_vm {
 	uint8_t c8_run;
 	uint8_t c8_draw;
-	uint8_t c8_shift_hack;
-	uint8_t c8_load_hack;
-	uint8_t c8_memory[MEMORY_SIZE];
+	uint8_t c8_quirks;
+	int (*c8_cycle)(struct c8_vm* vm);
+	int32_t c8_cycle_budget;
+	c8_page_t* c8_pages[C8_PAGE_COUNT];
 	uint8_t c8_registers[REGISTERS_COUNT];
 	uint8_t c8_frame_buffer[SCREEN_HEIGHT][SCREEN_FB_WIDTH];
 	uint8_t c8_delay_timer;
@@ -36,8 +79,15 @@ typedef struct {
 	uint16_t c8_stack[STACK_SIZE];
 	uint16_t c8_immediate;
 	uint16_t c8_program_counter;
+	uint32_t c8_rng;
 } c8_vm_t;
 
+extern const uint8_t c8_font[FONT_ARR_LENGTH];
+
+void c8_vm_init(c8_vm_t* vm, const c8_image_t* image, uint32_t seed);
+void c8_vm_destroy(c8_vm_t* vm);
+int c8_vm_frame(c8_vm_t* vm, uint32_t* cycles);
 int c8_vm_run(c8_vm_t* vm);
+int c8_vm_run_monitor(c8_vm_t* vms, int count);
 
 #endif
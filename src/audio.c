@@ -9,6 +9,7 @@
 #include <SDL2/SDL.h>
 #include <math.h>
 #include "audio.h"
+#include "metrics.h"
 
 #define SAMPLING_RATE 11250
 #define SOUND_DURATION 16
@@ -50,6 +51,13 @@ void c8_audio_init() {
 
 
 int c8_audio_play(c8_vm_t* vm) {
+	if (c8_metrics_enabled()) {
+		uint32_t queued = SDL_GetQueuedAudioSize(device);
+		int underrun = queued == 0 && vm->c8_sound_timer > 0 && last_timer_val > 0;
+
+		c8_metrics_audio((queued * 1000) / (SAMPLING_RATE * sizeof(float)), underrun);
+	}
+
 	if(vm->c8_sound_timer != last_timer_val) {
 		SDL_QueueAudio(device, samples, sizeof(float) * SAMPLE_COUNT);
 		last_timer_val = vm->c8_sound_timer;
@@ -8,60 +8,447 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
+#include <inttypes.h>
 #include <errno.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
+#include <limits.h>
 #include <SDL2/SDL.h>
 #include "vm.h"
+#include "quirks.h"
+#include "debug.h"
+#include "library.h"
+#include "trace.h"
+#include "metrics.h"
+#include "mem.h"
+#include "explore.h"
+#include "daemon.h"
 
-#define PROGRAMM_LOAD_ADDR 512
+#define EXPLORE_MAX_NODES 2000000
+#define EXPLORE_TABLE_BITS 23
 
-int read_program(const char* path, uint8_t* memory) {
-	int fd = open(path, O_RDONLY);
+/*
+ * detected_quirks may be NULL when they are already known, e.g. from the
+ * library index.
+ */
+int read_program(const char* path, c8_image_t* image, uint8_t* detected_quirks) {
+	c8_rom_t rom;
+	uint8_t platform;
+	int err = c8_rom_map(path, &rom);
 
-	if (fd == -1) {
-		return errno;
+	if (err != 0) {
+		return err;
 	}
 
-	struct stat file_info;
+	err = c8_mem_image_create(image, rom.data, rom.size);
+
+	if (detected_quirks != NULL) {
+		c8_rom_detect(rom.data, rom.size, &platform, detected_quirks);
+	}
 
-	if (fstat(fd, &file_info) == -1) {
-		close(fd);
-		return errno;
-	};
+	c8_rom_unmap(&rom);
 
-	if (read(fd, memory, file_info.st_size) == -1) {
-		close(fd);
-		return errno;
-	};
+	return err;
+}
+
+/*
+ * Explorer target: Vx scores a register, anything else is parsed as a
+ * memory address whose byte is scored.
+ */
+typedef struct {
+	int reg;
+	uint16_t addr;
+} explore_target_t;
+
+static int explore_score(const c8_vm_t* vm, void* user) {
+	explore_target_t* target = user;
+
+	if (target->reg >= 0) {
+		return vm->c8_registers[target->reg];
+	}
+
+	return c8_mem_read(vm, target->addr);
+}
 
-	close(fd);
+static int parse_explore(const char* arg, c8_explore_opts_t* opts, explore_target_t* target) {
+	char name[16];
+	int goal = INT_MAX;
+
+	if (sscanf(arg, "%d:%d:%15[^:]:%i", &opts->frames_per_step, &opts->max_depth, name, &goal) < 3
+			|| opts->frames_per_step < 1 || opts->max_depth < 1 || opts->max_depth > UINT16_MAX) {
+		return EINVAL;
+	}
+
+	opts->goal = goal;
+	target->reg = -1;
+
+	if ((name[0] == 'V' || name[0] == 'v') && name[1] != '\0' && name[2] == '\0') {
+		char* end;
+		long reg = strtol(name + 1, &end, 16);
+
+		if (*end != '\0') {
+			return EINVAL;
+		}
+
+		target->reg = reg;
+	} else {
+		char* end;
+		unsigned long addr = strtoul(name, &end, 16);
+
+		if (*end != '\0' || addr >= MEMORY_SIZE) {
+			return EINVAL;
+		}
+
+		target->addr = addr;
+	}
 
 	return 0;
 }
 
+static int run_explore(const c8_vm_t* vm, c8_explore_opts_t* opts) {
+	c8_explore_result_t result;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	opts->threads = cpus > 0 ? cpus : 1;
+	opts->max_nodes = EXPLORE_MAX_NODES;
+	opts->table_bits = EXPLORE_TABLE_BITS;
+
+	if (c8_explore(vm, opts, &result) != 0) {
+		puts("Out of memory");
+		return EXIT_FAILURE;
+	}
+
+	printf("%s score %d at depth %d, %" PRIu64 " expanded, %" PRIu64 " duplicates\n",
+			result.found ? "goal" : "best", result.score, result.depth, result.expanded, result.duplicates);
+
+	for (int i = 0; i < result.depth; i++) {
+		printf("%04x%c", result.inputs[i], (i % 16 == 15 || i == result.depth - 1) ? '\n' : ' ');
+	}
+
+	c8_explore_result_free(&result);
+
+	return 0;
+}
+
+static void usage() {
+	puts("Usage: chipollotto [-d] [-n count] [-S seed] [-t file [-R n]] [-M dest [-j]] [-O] [-q quirk,...] filename");
+	puts("       chipollotto -L dir [-d] [-n count] [-S seed] [-t file [-R n]] [-M dest [-j]] [-O] [-q quirk,...] [name|hash]");
+	puts("       chipollotto -E frames:depth:target[:goal] [-B] [-S seed] [-q quirk,...] filename");
+	puts("       chipollotto -D socket [-n workers] [-w]");
+	puts("  -d  start in the debugger (F12 breaks into it while running)");
+	puts("  -n  run count instances side by side, seeded seed, seed + 1, ...");
+	puts("  -S  random number seed");
+	puts("  -t  write a binary instruction trace to file, not with -n");
+	puts("  -R  with -t, only keep the last n million instructions");
+	puts("  -M  write host metrics every second to file, or to unix:/path");
+	puts("  -j  with -M, write metrics as JSON instead of text");
+	puts("  -O  show the metrics overlay (F11 toggles it)");
+	puts("  -L  index the ROMs in dir, list them or run one by name or hash prefix");
+	puts("  -E  search for the key presses, each held for frames, that maximize target");
+	puts("      (Vx or a hex address) up to depth steps or until it reaches goal");
+	puts("  -B  with -E, search best first instead of breadth first");
+	puts("  -D  serve ROM jobs on a unix socket, one worker per CPU unless -n is given");
+	puts("  -w  with -D, show the last finished job in a window");
+	puts("Quirks: shift, load, clip, vfreset, jump, vblank");
+	puts("Without -q the quirks are read from filename.quirks if it exists,");
+	puts("otherwise they are guessed from the ROM");
+}
+
+static void list_library(c8_library_t* lib) {
+	for (int i = 0; i < lib->count; i++) {
+		c8_rom_entry_t* e = &lib->entries[i];
+		char quirks[64] = "";
+
+		for (int q = 0; q < C8_QUIRK_COUNT; q++) {
+			if (e->quirks & (1 << q)) {
+				strcat(quirks, quirks[0] ? "," : "");
+				strcat(quirks, c8_quirks_name(1 << q));
+			}
+		}
+
+		printf("%016" PRIx64 " %5" PRIu32 " %-6s %-24s %s\n", e->hash, e->size, c8_platform_name(e->platform),
+				quirks[0] ? quirks : "-", e->name);
+	}
+}
+
 int main(int argc, char* argv[]) {
-	if (argc < 2) {
-		puts("Usage: chipollotto filename");
+	const char* quirk_names = NULL;
+	const char* library_dir = NULL;
+	const char* trace_path = NULL;
+	uint32_t trace_ring = 0;
+	const char* metrics_dest = NULL;
+	int metrics_json = 0;
+	int overlay = 0;
+	uint32_t seed = time(NULL);
+	int count = 0;
+	int debug = 0;
+	const char* daemon_path = NULL;
+	int window = 0;
+	c8_explore_opts_t explore_opts;
+	explore_target_t explore_target;
+	const char* explore = NULL;
+	int opt;
+
+	memset(&explore_opts, 0, sizeof(explore_opts));
+
+	while ((opt = getopt(argc, argv, "djn:q:t:wBD:E:L:M:OR:S:")) != -1) {
+		switch (opt) {
+			case 'd':
+				debug = 1;
+				break;
+			case 'n':
+				count = atoi(optarg);
+
+				if (count < 1) {
+					usage();
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'S':
+				seed = strtoul(optarg, NULL, 0);
+				break;
+			case 'q':
+				quirk_names = optarg;
+				break;
+			case 't':
+				trace_path = optarg;
+				break;
+			case 'j':
+				metrics_json = 1;
+				break;
+			case 'M':
+				metrics_dest = optarg;
+				break;
+			case 'O':
+				overlay = 1;
+				break;
+			case 'R': {
+				char* end;
+				unsigned long millions = strtoul(optarg, &end, 0);
+
+				if (end == optarg || *end != '\0' || millions == 0 || millions > UINT32_MAX / 1000000) {
+					usage();
+					return EXIT_FAILURE;
+				}
+
+				trace_ring = millions * 1000000;
+				break;
+			}
+			case 'L':
+				library_dir = optarg;
+				break;
+			case 'E':
+				explore = optarg;
+				break;
+			case 'B':
+				explore_opts.best_first = 1;
+				break;
+			case 'D':
+				daemon_path = optarg;
+				break;
+			case 'w':
+				window = 1;
+				break;
+			default:
+				usage();
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (daemon_path != NULL) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		/* jobs bring their own ROM and quirks, the other modes don't apply */
+		if (debug || trace_path != NULL || metrics_dest != NULL || overlay || quirk_names != NULL
+				|| library_dir != NULL || explore != NULL || optind < argc) {
+			usage();
+			return EXIT_FAILURE;
+		}
+
+		if (count == 0) {
+			count = cpus > 0 ? cpus : 1;
+		}
+
+		int err = c8_daemon_run(daemon_path, count, window);
+
+		if (err == EADDRINUSE) {
+			puts("A daemon is already serving that socket");
+			return EXIT_FAILURE;
+		} else if (err != 0) {
+			puts("Error opening daemon socket");
+			return EXIT_FAILURE;
+		}
+
+		return 0;
+	}
+
+	if (count == 0) {
+		count = 1;
+	}
+
+	char library_path[PATH_MAX];
+	const char* path;
+	uint8_t detected_quirks;
+	int indexed = 0;
+
+	if (library_dir != NULL) {
+		c8_library_t lib;
+
+		if (c8_library_open(&lib, library_dir) != 0) {
+			puts("Error indexing library");
+			return EXIT_FAILURE;
+		}
+
+		if (optind >= argc) {
+			list_library(&lib);
+			c8_library_close(&lib);
+			return 0;
+		}
+
+		c8_rom_entry_t* entry;
+		int err = c8_library_find(&lib, argv[optind], &entry);
+
+		if (err == EEXIST) {
+			puts("Ambiguous hash prefix");
+			c8_library_close(&lib);
+			return EXIT_FAILURE;
+		} else if (err != 0 || c8_library_path(&lib, entry, library_path, PATH_MAX) != 0) {
+			puts("No such ROM in library");
+			c8_library_close(&lib);
+			return EXIT_FAILURE;
+		}
+
+		detected_quirks = entry->quirks;
+		indexed = 1;
+		c8_library_close(&lib);
+		path = library_path;
+	} else if (optind < argc) {
+		path = argv[optind];
+	} else {
+		usage();
 		return EXIT_FAILURE;
 	}
 
 	c8_vm_t vm;
+	c8_image_t image;
 	memset(&vm, 0, sizeof(vm));
 
 	vm.c8_program_counter = PROGRAMM_LOAD_ADDR;
 
-	if (read_program(argv[1], &vm.c8_memory[vm.c8_program_counter]) != 0) {
+	int err = read_program(path, &image, indexed ? NULL : &detected_quirks);
+
+	if (err == EFBIG) {
+		puts("ROM does not fit into memory");
+		return EXIT_FAILURE;
+	} else if (err != 0) {
 		puts("Error reading file");
 		return EXIT_FAILURE;
 	}
 
-	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER | SDL_INIT_EVENTS);
-	c8_vm_run(&vm);
-	SDL_Quit();
+	if (quirk_names != NULL) {
+		if (c8_quirks_parse(quirk_names, &vm.c8_quirks) != 0) {
+			puts("Unknown quirk");
+			return EXIT_FAILURE;
+		}
+	} else {
+		err = c8_quirks_load_profile(path, &vm.c8_quirks);
+
+		if (err == ENOENT) {
+			vm.c8_quirks = detected_quirks;
+		} else if (err != 0) {
+			puts("Error reading quirk profile");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (explore != NULL) {
+		if (parse_explore(explore, &explore_opts, &explore_target) != 0) {
+			usage();
+			return EXIT_FAILURE;
+		}
+
+		explore_opts.score = explore_score;
+		explore_opts.user = &explore_target;
+		c8_vm_init(&vm, &image, seed);
+		err = run_explore(&vm, &explore_opts);
+		c8_vm_destroy(&vm);
+		c8_mem_image_destroy(&image);
+
+		return err;
+	}
+
+	if (debug) {
+		c8_debug_break(&vm);
+	}
+
+	if (trace_path != NULL && count > 1) {
+		puts("-t can only trace a single instance");
+		return EXIT_FAILURE;
+	}
+
+	if (trace_path != NULL && c8_trace_open(trace_path, trace_ring) != 0) {
+		puts("Error opening trace");
+		return EXIT_FAILURE;
+	}
+
+	if ((metrics_dest != NULL || overlay) && c8_metrics_init(metrics_dest, metrics_json, overlay, count) != 0) {
+		puts("Error opening metrics destination");
+		return EXIT_FAILURE;
+	}
+
+	if (count == 1) {
+		c8_vm_init(&vm, &image, seed);
+
+		SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER | SDL_INIT_EVENTS);
+		c8_vm_run(&vm);
+		SDL_Quit();
+
+		c8_vm_destroy(&vm);
+	} else {
+		c8_vm_t* vms = malloc(count * sizeof(c8_vm_t));
+
+		if (vms == NULL) {
+			puts("Out of memory");
+			return EXIT_FAILURE;
+		}
+
+		for (int i = 0; i < count; i++) {
+			memcpy(&vms[i], &vm, sizeof(vm));
+			c8_vm_init(&vms[i], &image, seed + i);
+		}
+
+		SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_EVENTS);
+		err = c8_vm_run_monitor(vms, count);
+		SDL_Quit();
+
+		if (err == E2BIG) {
+			puts("Too many instances for one window");
+		} else if (err != 0) {
+			puts("Error opening monitor window");
+		}
+
+		for (int i = 0; i < count; i++) {
+			c8_vm_destroy(&vms[i]);
+		}
+
+		free(vms);
+
+		if (err != 0) {
+			c8_mem_image_destroy(&image);
+			c8_metrics_destroy();
+			c8_trace_close();
+			return EXIT_FAILURE;
+		}
+	}
+
+	c8_mem_image_destroy(&image);
+	c8_metrics_destroy();
+
+	if (c8_trace_close() != 0) {
+		puts("Error writing trace");
+		return EXIT_FAILURE;
+	}
 
 	return 0;
 }
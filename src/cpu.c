@@ -7,9 +7,13 @@
  */
 
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "cpu.h"
+#include "mem.h"
+#include "debug.h"
+#include "trace.h"
 
 #define OPCODE_TYPE_MASK 		0xf000
 #define OPCODE_ALU_OP_MASK 		0x000f
@@ -69,10 +73,64 @@
 #define OPCODE_TYPE_EXT_DUMP	0x0055
 #define OPCODE_TYPE_EXT_LOAD	0x0065
 
+/*
+ * Every function taking a quirks argument is forced inline so that each
+ * interpreter variant below gets its own copy with the quirk tests folded
+ * away. Only the generic c8_cpu_exec_instr passes quirks known at runtime.
+ */
+#define C8_CPU_INLINE static inline __attribute__((always_inline))
 
+/*
+ * Pseudo-quirk set only for the instrumented variant, which reports memory
+ * writes to the debugger and the tracer. Kept out of C8_QUIRK_MASK so it
+ * never gets a specialized copy of its own.
+ */
+#define C8_CPU_INSTRUMENTED 0x80
+
+#define C8_CPU_VARIANTS(V) \
+	V(0)  V(1)  V(2)  V(3)  V(4)  V(5)  V(6)  V(7) \
+	V(8)  V(9)  V(10) V(11) V(12) V(13) V(14) V(15) \
+	V(16) V(17) V(18) V(19) V(20) V(21) V(22) V(23) \
+	V(24) V(25) V(26) V(27) V(28) V(29) V(30) V(31) \
+	V(32) V(33) V(34) V(35) V(36) V(37) V(38) V(39) \
+	V(40) V(41) V(42) V(43) V(44) V(45) V(46) V(47) \
+	V(48) V(49) V(50) V(51) V(52) V(53) V(54) V(55) \
+	V(56) V(57) V(58) V(59) V(60) V(61) V(62) V(63)
+
+/*
+ * Approximate COSMAC VIP interpreter timings in machine cycles. Every
+ * instruction pays the fetch and dispatch loop, then the cost of its
+ * routine, indexed by the top nibble or for 8XYN and FXNN by the low
+ * byte. DXYN and FX55/FX65 depend on their operands, see c8_cpu_cost.
+ */
+#define C8_VIP_FETCH_CYCLES 40
+#define C8_VIP_DRAW_CYCLES 26
+#define C8_VIP_DRAW_ROW_CYCLES 22
+#define C8_VIP_DRAW_SPILL_CYCLES 9
+#define C8_VIP_DRAW_SHIFT_CYCLES 4
+#define C8_VIP_REG_COPY_CYCLES 14
+
+static const uint16_t c8_cpu_costs[16] = {
+	23, 23, 23, 12, 12, 16, 6, 10, 44, 16, 12, 23, 36, 0, 16, 10
+};
+
+static const uint16_t c8_cpu_ext_costs[256] = {
+	[OPCODE_TYPE_EXT_GET_DLY] = 10,
+	[OPCODE_TYPE_EXT_KEY] = 10,
+	[OPCODE_TYPE_EXT_DELAY] = 10,
+	[OPCODE_TYPE_EXT_SOUND] = 10,
+	[OPCODE_TYPE_EXT_IMM] = 19,
+	[OPCODE_TYPE_EXT_FONT] = 20,
+	[OPCODE_TYPE_EXT_BCD] = 204,
+	[OPCODE_TYPE_EXT_DUMP] = C8_VIP_REG_COPY_CYCLES,
+	[OPCODE_TYPE_EXT_LOAD] = C8_VIP_REG_COPY_CYCLES
+};
 
 static inline uint16_t c8_cpu_fetch_instr(c8_vm_t* vm) {
-	return vm->c8_memory[vm->c8_program_counter++] << 8 | vm->c8_memory[vm->c8_program_counter++];
+	uint16_t pc = vm->c8_program_counter;
+	vm->c8_program_counter += 2;
+
+	return c8_mem_read(vm, pc) << 8 | c8_mem_read(vm, pc + 1);
 }
 
 static void c8_cpu_native(c8_vm_t* vm, uint16_t addr) {
@@ -119,19 +177,31 @@ static void c8_cpu_add_imm(c8_vm_t* vm, uint8_t x, uint8_t imm) {
 	vm->c8_registers[x] += imm;
 }
 
-static void c8_cpu_alu(c8_vm_t* vm, uint8_t x, uint8_t y, uint16_t alu_op) {
+C8_CPU_INLINE void c8_cpu_alu(c8_vm_t* vm, uint8_t x, uint8_t y, uint16_t alu_op, const uint8_t quirks) {
 	switch (alu_op) {
 		case OPCODE_ALU_OP_ASSIGN:
 			vm->c8_registers[x] = vm->c8_registers[y];
 			break;
 		case OPCODE_ALU_OP_BIT_OR:
 			vm->c8_registers[x] = vm->c8_registers[x] | vm->c8_registers[y];
+
+			if (quirks & C8_QUIRK_VF_RESET) {
+				vm->c8_registers[REGISTER_VF] = 0;
+			}
 			break;
 		case OPCODE_ALU_OP_BIT_AND:
 			vm->c8_registers[x] = vm->c8_registers[x] & vm->c8_registers[y];
+
+			if (quirks & C8_QUIRK_VF_RESET) {
+				vm->c8_registers[REGISTER_VF] = 0;
+			}
 			break;
 		case OPCODE_ALU_OP_BIT_XOR:
 			vm->c8_registers[x] = vm->c8_registers[x] ^ vm->c8_registers[y];
+
+			if (quirks & C8_QUIRK_VF_RESET) {
+				vm->c8_registers[REGISTER_VF] = 0;
+			}
 			break;
 		case OPCODE_ALU_OP_ADD_X:
 			if ((vm->c8_registers[x] + vm->c8_registers[y]) > 0xff) {
@@ -150,7 +220,7 @@ static void c8_cpu_alu(c8_vm_t* vm, uint8_t x, uint8_t y, uint16_t alu_op) {
 			vm->c8_registers[x] -= vm->c8_registers[y];
 			break;
 		case OPCODE_ALU_OP_BIT_MOV_R:
-			if (vm->c8_shift_hack) {
+			if (quirks & C8_QUIRK_SHIFT) {
 				y = x;
 			}
 
@@ -166,7 +236,7 @@ static void c8_cpu_alu(c8_vm_t* vm, uint8_t x, uint8_t y, uint16_t alu_op) {
 			vm->c8_registers[x] = vm->c8_registers[y] - vm->c8_registers[x];
 			break;
 		case OPCODE_ALU_OP_BIT_MOV_L:
-			if (vm->c8_shift_hack) {
+			if (quirks & C8_QUIRK_SHIFT) {
 				y = x;
 			}
 
@@ -189,43 +259,64 @@ static void c8_cpu_mov_i(c8_vm_t* vm, uint16_t addr) {
 	vm->c8_immediate = addr;
 }
 
-static void c8_cpu_jmp_v0(c8_vm_t* vm, uint16_t addr) {
-	vm->c8_program_counter = addr + vm->c8_registers[0];
+C8_CPU_INLINE void c8_cpu_jmp_v0(c8_vm_t* vm, uint16_t addr, const uint8_t quirks) {
+	if (quirks & C8_QUIRK_JUMP) {
+		vm->c8_program_counter = addr + vm->c8_registers[(addr & OPCODE_REG_X_MASK) >> 8];
+	} else {
+		vm->c8_program_counter = addr + vm->c8_registers[0];
+	}
 }
 
 static void c8_cpu_rand(c8_vm_t* vm, uint8_t x, uint8_t imm) {
-	vm->c8_registers[x] = (rand() % 256) & imm;
+	uint32_t r = vm->c8_rng;
+
+	r ^= r << 13;
+	r ^= r >> 17;
+	r ^= r << 5;
+	vm->c8_rng = r;
+
+	vm->c8_registers[x] = (r >> 24) & imm;
 }
 
-static void c8_cpu_draw(c8_vm_t* vm, uint8_t vx, uint8_t vy, uint8_t sprite_height) {
-	uint8_t x = vm->c8_registers[vx];
-	uint8_t y = vm->c8_registers[vy];
+static inline void c8_cpu_draw_byte(c8_vm_t* vm, uint8_t row, uint8_t col, uint8_t bits) {
+	uint8_t* pix = &vm->c8_frame_buffer[row][col];
+
+	if (*pix & bits) {
+		vm->c8_registers[REGISTER_VF] = 1;
+	}
+
+	*pix ^= bits;
+}
+
+C8_CPU_INLINE void c8_cpu_draw(c8_vm_t* vm, uint8_t vx, uint8_t vy, uint8_t sprite_height, const uint8_t quirks) {
+	uint8_t x = vm->c8_registers[vx] % SCREEN_WIDTH;
+	uint8_t y = vm->c8_registers[vy] % SCREEN_HEIGHT;
+	uint8_t col = x / 8;
+	uint8_t shift = x % 8;
 	vm->c8_registers[REGISTER_VF] = 0;
 	vm->c8_draw = 1;
 
 	for (int i = 0; i < sprite_height; i++) {
-		if (x >= SCREEN_WIDTH || y >= SCREEN_HEIGHT) {
-			continue;
-		}
+		uint8_t row = y + i;
 
-		if ((x % 8) != 0) {
-			uint16_t pixs = (vm->c8_frame_buffer[y + i][(x / 8)] << 8) | vm->c8_frame_buffer[y + i][(x / 8) + 1];
+		if (row >= SCREEN_HEIGHT) {
+			if (quirks & C8_QUIRK_CLIP) {
+				break;
+			}
 
-			vm->c8_frame_buffer[y + i][(x / 8)] ^= vm->c8_memory[vm->c8_immediate + i] >> (x % 8);
-			vm->c8_frame_buffer[y + i][(x / 8) + 1] ^= vm->c8_memory[vm->c8_immediate + i] << (8 - (x % 8));
+			row -= SCREEN_HEIGHT;
+		}
 
-			if ((pixs & ((vm->c8_frame_buffer[y + i][(x / 8)] << 8) | vm->c8_frame_buffer[y + i][(x / 8) + 1])) != pixs) {
-				vm->c8_registers[REGISTER_VF] = 1;
-			}
-		} else {
-			uint8_t pix = vm->c8_frame_buffer[y + i][x / 8];
-			vm->c8_frame_buffer[y + i][x / 8] ^= vm->c8_memory[vm->c8_immediate + i];
+		uint8_t sprite = c8_mem_read(vm, vm->c8_immediate + i);
+		c8_cpu_draw_byte(vm, row, col, sprite >> shift);
 
-			if((pix & vm->c8_frame_buffer[y + i][x / 8]) != pix) {
-				vm->c8_registers[REGISTER_VF] = 1;
+		if (shift != 0) {
+			if (col + 1 < SCREEN_FB_WIDTH) {
+				c8_cpu_draw_byte(vm, row, col + 1, sprite << (8 - shift));
+			} else if (!(quirks & C8_QUIRK_CLIP)) {
+				c8_cpu_draw_byte(vm, row, 0, sprite << (8 - shift));
 			}
 		}
-
 	}
 }
 
@@ -263,34 +354,44 @@ static void c8_cpu_key_read(c8_vm_t* vm, uint8_t x) {
 	}
 }
 
-static void c8_cpu_bcd(c8_vm_t* vm, uint8_t x) {
+C8_CPU_INLINE void c8_cpu_write(c8_vm_t* vm, uint16_t addr, uint8_t val, const uint8_t quirks) {
+	if (quirks & C8_CPU_INSTRUMENTED) {
+		addr &= MEMORY_SIZE - 1;
+		c8_debug_watch(vm, addr, c8_mem_read(vm, addr), val);
+		c8_trace_write(addr, val);
+	}
+
+	c8_mem_write(vm, addr, val);
+}
+
+C8_CPU_INLINE void c8_cpu_bcd(c8_vm_t* vm, uint8_t x, const uint8_t quirks) {
 	uint8_t a = vm->c8_registers[x];
-	vm->c8_memory[vm->c8_immediate] = (a / 100) % 10;
-	vm->c8_memory[vm->c8_immediate + 1] = (a / 10) % 10;
-	vm->c8_memory[vm->c8_immediate + 2] = a % 10;
+	c8_cpu_write(vm, vm->c8_immediate, (a / 100) % 10, quirks);
+	c8_cpu_write(vm, vm->c8_immediate + 1, (a / 10) % 10, quirks);
+	c8_cpu_write(vm, vm->c8_immediate + 2, a % 10, quirks);
 }
 
-static void c8_cpu_dump(c8_vm_t* vm, uint8_t x) {
+C8_CPU_INLINE void c8_cpu_dump(c8_vm_t* vm, uint8_t x, const uint8_t quirks) {
 	for (int i = 0; i <= x; i++) {
-		vm->c8_memory[vm->c8_immediate++] = vm->c8_registers[i];
+		c8_cpu_write(vm, vm->c8_immediate++, vm->c8_registers[i], quirks);
 	}
 
-	if(vm->c8_load_hack) {
+	if (quirks & C8_QUIRK_LOAD) {
 		vm->c8_immediate -= x + 1;
 	}
 }
 
-static void c8_cpu_load(c8_vm_t* vm, uint8_t x) {
+C8_CPU_INLINE void c8_cpu_load(c8_vm_t* vm, uint8_t x, const uint8_t quirks) {
 	for (int i = 0; i <= x; i++) {
-		vm->c8_registers[i] = vm->c8_memory[vm->c8_immediate++];
+		vm->c8_registers[i] = c8_mem_read(vm, vm->c8_immediate++);
 	}
 
-	if(vm->c8_load_hack) {
+	if (quirks & C8_QUIRK_LOAD) {
 		vm->c8_immediate -= x + 1;
 	}
 }
 
-static void c8_cpu_ext(c8_vm_t* vm, uint8_t x, uint8_t opcode_ext_option) {
+C8_CPU_INLINE void c8_cpu_ext(c8_vm_t* vm, uint8_t x, uint8_t opcode_ext_option, const uint8_t quirks) {
 	switch (opcode_ext_option) {
 		case OPCODE_TYPE_EXT_GET_DLY:
 			vm->c8_registers[x] = vm->c8_delay_timer;
@@ -311,20 +412,20 @@ static void c8_cpu_ext(c8_vm_t* vm, uint8_t x, uint8_t opcode_ext_option) {
 			vm->c8_immediate = (vm->c8_registers[x] * 5) + FONT_ADDR;
 			break;
 		 case OPCODE_TYPE_EXT_BCD:
-			 c8_cpu_bcd(vm, x);
+			 c8_cpu_bcd(vm, x, quirks);
 			 break;
 		case OPCODE_TYPE_EXT_DUMP:
-			c8_cpu_dump(vm, x);
+			c8_cpu_dump(vm, x, quirks);
 			break;
 		case OPCODE_TYPE_EXT_LOAD:
-			c8_cpu_load(vm, x);
+			c8_cpu_load(vm, x, quirks);
 			break;
 		default:
 			break;
 	}
 }
 
-int c8_cpu_exec_instr(c8_vm_t* vm, uint16_t instr) {
+C8_CPU_INLINE int c8_cpu_exec(c8_vm_t* vm, uint16_t instr, const uint8_t quirks) {
 	switch (instr & OPCODE_TYPE_MASK) {
 	    case OPCODE_TYPE_NATIVE:
 	    	c8_cpu_native(vm, instr & OPCODE_ADDR_MASK);
@@ -351,7 +452,7 @@ int c8_cpu_exec_instr(c8_vm_t* vm, uint16_t instr) {
 	    	c8_cpu_add_imm(vm, OPCODE_REG_X_ARG(instr), instr & OPCODE_IMM_MASK);
 	    	break;
 	    case OPCODE_TYPE_ALU:
-	    	c8_cpu_alu(vm, OPCODE_REG_X_ARG(instr), OPCODE_REG_Y_ARG(instr), instr & OPCODE_ALU_OP_MASK);
+	    	c8_cpu_alu(vm, OPCODE_REG_X_ARG(instr), OPCODE_REG_Y_ARG(instr), instr & OPCODE_ALU_OP_MASK, quirks);
 	    	break;
 	    case OPCODE_TYPE_JNEQ:
 	    	c8_cpu_jneq(vm, OPCODE_REG_X_ARG(instr), OPCODE_REG_Y_ARG(instr));
@@ -360,19 +461,19 @@ int c8_cpu_exec_instr(c8_vm_t* vm, uint16_t instr) {
 	    	c8_cpu_mov_i(vm, instr & OPCODE_ADDR_MASK);
 	        break;
 	    case OPCODE_TYPE_JMP_V0:
-	    	c8_cpu_jmp_v0(vm, instr & OPCODE_ADDR_MASK);
+	    	c8_cpu_jmp_v0(vm, instr & OPCODE_ADDR_MASK, quirks);
 	        break;
 	    case OPCODE_TYPE_RAND:
 	    	c8_cpu_rand(vm, OPCODE_REG_X_ARG(instr), instr & OPCODE_IMM_MASK);
 	    	break;
 	    case OPCODE_TYPE_DRAW:
-	    	c8_cpu_draw(vm, OPCODE_REG_X_ARG(instr), OPCODE_REG_Y_ARG(instr), instr & OPCODE_SPRITE_H_MASK);
+	    	c8_cpu_draw(vm, OPCODE_REG_X_ARG(instr), OPCODE_REG_Y_ARG(instr), instr & OPCODE_SPRITE_H_MASK, quirks);
 	    	break;
 	    case OPCODE_TYPE_KEY:
 	    	c8_cpu_key(vm, OPCODE_REG_X_ARG(instr), instr & OPCODE_KEY_MASK);
 	    	break;
 	    case OPCODE_TYPE_EXT:
-	    	c8_cpu_ext(vm, OPCODE_REG_X_ARG(instr), instr & OPCODE_EXT_OP_MASK);
+	    	c8_cpu_ext(vm, OPCODE_REG_X_ARG(instr), instr & OPCODE_EXT_OP_MASK, quirks);
 	    	break;
 	    default:
 	    	return -1;
@@ -381,9 +482,228 @@ int c8_cpu_exec_instr(c8_vm_t* vm, uint16_t instr) {
 	return 0;
 }
 
-int c8_cpu_cycle(c8_vm_t* vm) {
+/*
+ * Taken before the instruction runs, since DXYN and FX55/FX65 may
+ * overwrite the registers their cost depends on. Sprite rows straddling
+ * a byte boundary are shifted bit by bit and touch a second byte.
+ */
+C8_CPU_INLINE int c8_cpu_cost(c8_vm_t* vm, uint16_t instr, const uint8_t quirks) {
+	uint8_t x = OPCODE_REG_X_ARG(instr);
+
+	switch (instr & OPCODE_TYPE_MASK) {
+		case OPCODE_TYPE_DRAW: {
+			uint8_t shift = vm->c8_registers[x] % 8;
+			int visible = SCREEN_HEIGHT - vm->c8_registers[OPCODE_REG_Y_ARG(instr)] % SCREEN_HEIGHT;
+			int rows = instr & OPCODE_SPRITE_H_MASK;
+			int row_cost = C8_VIP_DRAW_ROW_CYCLES;
+
+			if ((quirks & C8_QUIRK_CLIP) && rows > visible) {
+				rows = visible;
+			}
+
+			if (shift != 0) {
+				row_cost += C8_VIP_DRAW_SPILL_CYCLES + shift * C8_VIP_DRAW_SHIFT_CYCLES;
+			}
+
+			return C8_VIP_FETCH_CYCLES + C8_VIP_DRAW_CYCLES + rows * row_cost;
+		}
+		case OPCODE_TYPE_EXT: {
+			uint8_t op = instr & OPCODE_EXT_OP_MASK;
+
+			if (op == OPCODE_TYPE_EXT_DUMP || op == OPCODE_TYPE_EXT_LOAD) {
+				return C8_VIP_FETCH_CYCLES + c8_cpu_ext_costs[op] + (x + 1) * C8_VIP_REG_COPY_CYCLES;
+			}
+
+			return C8_VIP_FETCH_CYCLES + c8_cpu_ext_costs[op];
+		}
+		default:
+			return C8_VIP_FETCH_CYCLES + c8_cpu_costs[instr >> 12];
+	}
+}
+
+/*
+ * On the VIP, DXYN under the display wait quirk and FX0A without a key
+ * pressed idle until the next frame, so the rest of the batch is dropped
+ * instead of spinning through it.
+ */
+C8_CPU_INLINE void c8_cpu_stall(c8_vm_t* vm, uint16_t instr, const uint8_t quirks) {
+	if (((quirks & C8_QUIRK_VBLANK) && (instr & OPCODE_TYPE_MASK) == OPCODE_TYPE_DRAW)
+			|| ((instr & (OPCODE_TYPE_MASK | OPCODE_EXT_OP_MASK)) == (OPCODE_TYPE_EXT | OPCODE_TYPE_EXT_KEY) && vm->c8_keypad == 0)) {
+		vm->c8_cycle_budget = 0;
+	}
+}
+
+/*
+ * Runs one instruction and returns what it cost in VIP machine cycles.
+ */
+C8_CPU_INLINE int c8_cpu_step(c8_vm_t* vm, const uint8_t quirks) {
 	uint16_t instr = c8_cpu_fetch_instr(vm);
-	c8_cpu_exec_instr(vm, instr);
+	int cost = c8_cpu_cost(vm, instr, quirks);
 
-	return 0;
+	c8_cpu_exec(vm, instr, quirks);
+	c8_cpu_stall(vm, instr, quirks);
+
+	return cost;
+}
+
+#define C8_CPU_VARIANT(q) \
+	static int c8_cpu_cycle_q##q(c8_vm_t* vm) { \
+		return c8_cpu_step(vm, q); \
+	}
+
+#define C8_CPU_VARIANT_PTR(q) c8_cpu_cycle_q##q,
+
+C8_CPU_VARIANTS(C8_CPU_VARIANT)
+
+static int (*const c8_cpu_variants[])(c8_vm_t* vm) = {
+	C8_CPU_VARIANTS(C8_CPU_VARIANT_PTR)
+};
+
+_Static_assert(sizeof(c8_cpu_variants) / sizeof(c8_cpu_variants[0]) == (1 << C8_QUIRK_COUNT), "one interpreter variant per quirk combination");
+
+/*
+ * Only switched in while the debugger has something armed or a trace is
+ * being recorded, so none of their checks run in the specialized variants
+ * above.
+ */
+static int c8_cpu_cycle_instrumented(c8_vm_t* vm) {
+	int tracing = c8_trace_active();
+	int cost;
+
+	c8_debug_check(vm);
+
+	if (!vm->c8_run) {
+		return 0;
+	}
+
+	if (tracing) {
+		c8_trace_begin(vm);
+	}
+
+	cost = c8_cpu_step(vm, vm->c8_quirks | C8_CPU_INSTRUMENTED);
+
+	if (tracing) {
+		c8_trace_end(vm);
+	}
+
+	return cost;
+}
+
+int c8_cpu_exec_instr(c8_vm_t* vm, uint16_t instr) {
+	return c8_cpu_exec(vm, instr, vm->c8_quirks);
+}
+
+void c8_cpu_select(c8_vm_t* vm) {
+	if (c8_debug_armed() || c8_trace_active()) {
+		vm->c8_cycle = c8_cpu_cycle_instrumented;
+	} else {
+		vm->c8_cycle = c8_cpu_variants[vm->c8_quirks & C8_QUIRK_MASK];
+	}
+}
+
+int c8_cpu_cycle(c8_vm_t* vm) {
+	return vm->c8_cycle(vm);
+}
+
+int c8_cpu_disasm(uint16_t instr, char* buf, size_t len) {
+	uint8_t x = OPCODE_REG_X_ARG(instr);
+	uint8_t y = OPCODE_REG_Y_ARG(instr);
+	uint16_t addr = instr & OPCODE_ADDR_MASK;
+	uint8_t imm = instr & OPCODE_IMM_MASK;
+
+	switch (instr & OPCODE_TYPE_MASK) {
+		case OPCODE_TYPE_NATIVE:
+			if (addr == OPCODE_CLR_ADDR) {
+				return snprintf(buf, len, "CLS");
+			} else if (addr == OPCODE_RET_ADDR) {
+				return snprintf(buf, len, "RET");
+			}
+			return snprintf(buf, len, "SYS 0x%03x", addr);
+		case OPCODE_TYPE_JMP:
+			return snprintf(buf, len, "JP 0x%03x", addr);
+		case OPCODE_TYPE_CALL:
+			return snprintf(buf, len, "CALL 0x%03x", addr);
+		case OPCODE_TYPE_JEQ_IMM:
+			return snprintf(buf, len, "SE V%X, 0x%02x", x, imm);
+		case OPCODE_TYPE_JNEQ_IMM:
+			return snprintf(buf, len, "SNE V%X, 0x%02x", x, imm);
+		case OPCODE_TYPE_JEQ:
+			return snprintf(buf, len, "SE V%X, V%X", x, y);
+		case OPCODE_TYPE_MOV_IMM:
+			return snprintf(buf, len, "LD V%X, 0x%02x", x, imm);
+		case OPCODE_TYPE_ADD_IMM:
+			return snprintf(buf, len, "ADD V%X, 0x%02x", x, imm);
+		case OPCODE_TYPE_ALU:
+			switch (instr & OPCODE_ALU_OP_MASK) {
+				case OPCODE_ALU_OP_ASSIGN:
+					return snprintf(buf, len, "LD V%X, V%X", x, y);
+				case OPCODE_ALU_OP_BIT_OR:
+					return snprintf(buf, len, "OR V%X, V%X", x, y);
+				case OPCODE_ALU_OP_BIT_AND:
+					return snprintf(buf, len, "AND V%X, V%X", x, y);
+				case OPCODE_ALU_OP_BIT_XOR:
+					return snprintf(buf, len, "XOR V%X, V%X", x, y);
+				case OPCODE_ALU_OP_ADD_X:
+					return snprintf(buf, len, "ADD V%X, V%X", x, y);
+				case OPCODE_ALU_OP_SUB_X:
+					return snprintf(buf, len, "SUB V%X, V%X", x, y);
+				case OPCODE_ALU_OP_BIT_MOV_R:
+					return snprintf(buf, len, "SHR V%X, V%X", x, y);
+				case OPCODE_ALU_OP_SUBN_X:
+					return snprintf(buf, len, "SUBN V%X, V%X", x, y);
+				case OPCODE_ALU_OP_BIT_MOV_L:
+					return snprintf(buf, len, "SHL V%X, V%X", x, y);
+				default:
+					break;
+			}
+			break;
+		case OPCODE_TYPE_JNEQ:
+			return snprintf(buf, len, "SNE V%X, V%X", x, y);
+		case OPCODE_TYPE_MOV_I:
+			return snprintf(buf, len, "LD I, 0x%03x", addr);
+		case OPCODE_TYPE_JMP_V0:
+			return snprintf(buf, len, "JP V0, 0x%03x", addr);
+		case OPCODE_TYPE_RAND:
+			return snprintf(buf, len, "RND V%X, 0x%02x", x, imm);
+		case OPCODE_TYPE_DRAW:
+			return snprintf(buf, len, "DRW V%X, V%X, %d", x, y, instr & OPCODE_SPRITE_H_MASK);
+		case OPCODE_TYPE_KEY:
+			switch (instr & OPCODE_KEY_MASK) {
+				case OPCODE_KEY_DOWN_MAP:
+					return snprintf(buf, len, "SKP V%X", x);
+				case OPCODE_KEY_UP_MAP:
+					return snprintf(buf, len, "SKNP V%X", x);
+				default:
+					break;
+			}
+			break;
+		case OPCODE_TYPE_EXT:
+			switch (instr & OPCODE_EXT_OP_MASK) {
+				case OPCODE_TYPE_EXT_GET_DLY:
+					return snprintf(buf, len, "LD V%X, DT", x);
+				case OPCODE_TYPE_EXT_KEY:
+					return snprintf(buf, len, "LD V%X, K", x);
+				case OPCODE_TYPE_EXT_DELAY:
+					return snprintf(buf, len, "LD DT, V%X", x);
+				case OPCODE_TYPE_EXT_SOUND:
+					return snprintf(buf, len, "LD ST, V%X", x);
+				case OPCODE_TYPE_EXT_IMM:
+					return snprintf(buf, len, "ADD I, V%X", x);
+				case OPCODE_TYPE_EXT_FONT:
+					return snprintf(buf, len, "LD F, V%X", x);
+				case OPCODE_TYPE_EXT_BCD:
+					return snprintf(buf, len, "LD B, V%X", x);
+				case OPCODE_TYPE_EXT_DUMP:
+					return snprintf(buf, len, "LD [I], V%X", x);
+				case OPCODE_TYPE_EXT_LOAD:
+					return snprintf(buf, len, "LD V%X, [I]", x);
+				default:
+					break;
+			}
+			break;
+		default:
+			break;
+	}
+
+	return snprintf(buf, len, "DW 0x%04x", instr);
 }
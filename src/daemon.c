@@ -0,0 +1,423 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <SDL2/SDL.h>
+#include "daemon.h"
+#include "mem.h"
+#include "library.h"
+#include "timer.h"
+#include "display.h"
+#include "audio.h"
+
+typedef struct {
+	c8_image_t image;
+	int has_image;
+	uint8_t detected_quirks;
+	c8_vm_t vm;
+	int has_vm;
+	uint16_t* inputs;
+	uint32_t inputs_capacity;
+} c8_session_t;
+
+static int c8_daemon_socket = -1;
+static int c8_daemon_window;
+
+/*
+ * Last finished job, picked up by the main thread when a window is open.
+ */
+static pthread_mutex_t c8_daemon_shown_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t c8_daemon_shown[SCREEN_HEIGHT][SCREEN_FB_WIDTH];
+static uint8_t c8_daemon_shown_sound;
+static int c8_daemon_shown_dirty;
+
+static int c8_daemon_read(int fd, void* buf, size_t len) {
+	uint8_t* p = buf;
+
+	while (len > 0) {
+		ssize_t n = recv(fd, p, len, 0);
+
+		if (n == 0) {
+			return EPIPE;
+		} else if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return errno;
+		}
+
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int c8_daemon_write(int fd, const void* buf, size_t len) {
+	const uint8_t* p = buf;
+
+	while (len > 0) {
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return errno;
+		}
+
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int c8_daemon_load(c8_session_t* s, int fd, uint16_t size) {
+	uint8_t rom[MEMORY_SIZE - PROGRAMM_LOAD_ADDR];
+	uint8_t platform;
+	int err;
+
+	if (size > sizeof(rom)) {
+		return EFBIG;
+	}
+
+	if ((err = c8_daemon_read(fd, rom, size)) != 0) {
+		return err;
+	}
+
+	if (s->has_image) {
+		c8_mem_image_destroy(&s->image);
+		s->has_image = 0;
+	}
+
+	if ((err = c8_mem_image_create(&s->image, rom, size)) != 0) {
+		return err;
+	}
+
+	c8_rom_detect(rom, size, &platform, &s->detected_quirks);
+	s->has_image = 1;
+
+	return 0;
+}
+
+static int c8_daemon_read_inputs(c8_session_t* s, int fd, uint32_t count) {
+	if (count > s->inputs_capacity) {
+		uint16_t* inputs = realloc(s->inputs, count * sizeof(uint16_t));
+
+		if (inputs == NULL) {
+			return ENOMEM;
+		}
+
+		s->inputs = inputs;
+		s->inputs_capacity = count;
+	}
+
+	return c8_daemon_read(fd, s->inputs, count * sizeof(uint16_t));
+}
+
+static void c8_daemon_show(c8_vm_t* vm) {
+	pthread_mutex_lock(&c8_daemon_shown_lock);
+	memcpy(c8_daemon_shown, vm->c8_frame_buffer, FRAME_BUFFER_SIZE);
+	c8_daemon_shown_sound = vm->c8_sound_timer;
+	c8_daemon_shown_dirty = 1;
+	pthread_mutex_unlock(&c8_daemon_shown_lock);
+}
+
+static void c8_daemon_boot(c8_session_t* s, const c8_job_t* job) {
+	if (s->has_vm) {
+		c8_vm_destroy(&s->vm);
+	}
+
+	memset(&s->vm, 0, sizeof(s->vm));
+	s->vm.c8_program_counter = PROGRAMM_LOAD_ADDR;
+	s->vm.c8_quirks = (job->flags & C8_JOB_QUIRKS) ? job->quirks & C8_QUIRK_MASK : s->detected_quirks;
+	c8_vm_init(&s->vm, &s->image, job->seed);
+	s->has_vm = 1;
+}
+
+static void c8_daemon_result(c8_vm_t* vm, c8_job_result_t* result) {
+	result->run = vm->c8_run;
+	memcpy(result->registers, vm->c8_registers, REGISTERS_COUNT);
+	result->immediate = vm->c8_immediate;
+	result->program_counter = vm->c8_program_counter;
+	result->stack_counter = vm->c8_stack_counter;
+	result->delay_timer = vm->c8_delay_timer;
+	result->sound_timer = vm->c8_sound_timer;
+	memcpy(result->stack, vm->c8_stack, sizeof(result->stack));
+	memcpy(result->frame_buffer, vm->c8_frame_buffer, FRAME_BUFFER_SIZE);
+}
+
+/*
+ * Reads and runs one job. Errors in the job itself are reported in the
+ * result; a nonzero return means the connection is unusable.
+ */
+static int c8_daemon_job(c8_session_t* s, int fd) {
+	c8_job_t job;
+	c8_job_result_t result;
+	int err;
+
+	if ((err = c8_daemon_read(fd, &job, sizeof(job))) != 0) {
+		return err;
+	}
+
+	memset(&result, 0, sizeof(result));
+	result.magic = C8_JOB_MAGIC;
+
+	if (job.magic != C8_JOB_MAGIC || job.input_count > C8_JOB_MAX_INPUTS) {
+		result.status = EPROTO;
+		c8_daemon_write(fd, &result, sizeof(result));
+		return EPROTO;
+	}
+
+	if (job.rom_size != 0) {
+		err = c8_daemon_load(s, fd, job.rom_size);
+	}
+
+	if (err == 0) {
+		err = c8_daemon_read_inputs(s, fd, job.input_count);
+	}
+
+	if (err != 0) {
+		result.status = err;
+		c8_daemon_write(fd, &result, sizeof(result));
+		return err;
+	}
+
+	if (!s->has_image) {
+		err = ENOENT;
+	} else if (job.frames > C8_JOB_MAX_FRAMES) {
+		err = E2BIG;
+	} else {
+		if (job.rom_size != 0 || !(job.flags & C8_JOB_RESUME) || !s->has_vm) {
+			c8_daemon_boot(s, &job);
+		}
+
+		for (result.frames = 0; result.frames < job.frames && s->vm.c8_run; result.frames++) {
+			if (job.input_count != 0) {
+				s->vm.c8_keypad = s->inputs[result.frames < job.input_count ? result.frames : job.input_count - 1];
+			}
+
+			c8_vm_frame(&s->vm, NULL);
+		}
+
+		c8_daemon_result(&s->vm, &result);
+
+		if (c8_daemon_window) {
+			c8_daemon_show(&s->vm);
+		}
+	}
+
+	result.status = err;
+
+	return c8_daemon_write(fd, &result, sizeof(result));
+}
+
+static void c8_daemon_serve(int fd) {
+	c8_session_t s;
+
+	memset(&s, 0, sizeof(s));
+
+	while (c8_daemon_job(&s, fd) == 0);
+
+	if (s.has_vm) {
+		c8_vm_destroy(&s.vm);
+	}
+
+	if (s.has_image) {
+		c8_mem_image_destroy(&s.image);
+	}
+
+	free(s.inputs);
+	close(fd);
+}
+
+/*
+ * Workers block in accept() on the shared socket, so an idle worker
+ * picks up the next connection without a hand-off.
+ */
+static void* c8_daemon_worker(void* arg) {
+	(void) arg;
+
+	for (;;) {
+		int fd = accept(c8_daemon_socket, NULL, NULL);
+
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+
+			break;
+		}
+
+		c8_daemon_serve(fd);
+	}
+
+	return NULL;
+}
+
+/*
+ * Returns 0 if a daemon answers on the socket at addr, otherwise the
+ * error connect() failed with.
+ */
+static int c8_daemon_probe(const struct sockaddr_un* addr) {
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	int err = 0;
+
+	if (fd < 0) {
+		return errno;
+	}
+
+	if (connect(fd, (const struct sockaddr *) addr, sizeof(*addr)) != 0) {
+		err = errno;
+	}
+
+	close(fd);
+
+	return err;
+}
+
+/*
+ * A socket left behind by an earlier daemon is replaced, a live one or
+ * anything else at path is left alone.
+ */
+static int c8_daemon_listen(const char* path) {
+	struct sockaddr_un addr;
+	struct stat st;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		return ENAMETOOLONG;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (lstat(path, &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			return EEXIST;
+		}
+
+		int err = c8_daemon_probe(&addr);
+
+		if (err == 0) {
+			return EADDRINUSE;
+		} else if (err != ECONNREFUSED) {
+			return err;
+		}
+
+		unlink(path);
+	}
+
+	if ((c8_daemon_socket = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		return errno;
+	}
+
+	if (bind(c8_daemon_socket, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(c8_daemon_socket, SOMAXCONN) != 0) {
+		int err = errno;
+		close(c8_daemon_socket);
+		c8_daemon_socket = -1;
+		return err;
+	}
+
+	return 0;
+}
+
+/*
+ * With a window the main thread shows the state of the last finished job
+ * at 60 Hz until the window is closed, which also stops the daemon. Keys
+ * are not scanned: jobs bring their own input, and F12 would arm the
+ * debugger for every worker VM booted afterwards.
+ */
+static void c8_daemon_window_run() {
+	c8_vm_t vm;
+	SDL_Event e;
+
+	memset(&vm, 0, sizeof(vm));
+	vm.c8_run = 1;
+
+	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER | SDL_INIT_EVENTS);
+	c8_timer_init();
+	c8_display_init();
+	c8_audio_init();
+
+	while (vm.c8_run) {
+		while (SDL_PollEvent(&e)) {
+			if (e.type == SDL_QUIT) {
+				vm.c8_run = 0;
+			}
+		}
+
+		pthread_mutex_lock(&c8_daemon_shown_lock);
+
+		if (c8_daemon_shown_dirty) {
+			memcpy(vm.c8_frame_buffer, c8_daemon_shown, FRAME_BUFFER_SIZE);
+			vm.c8_sound_timer = c8_daemon_shown_sound;
+			vm.c8_draw = 1;
+			c8_daemon_shown_dirty = 0;
+		}
+
+		pthread_mutex_unlock(&c8_daemon_shown_lock);
+		c8_display_draw(&vm);
+		c8_audio_play(&vm);
+		c8_timer_tick(&vm);
+		c8_timer_wait_frame();
+	}
+
+	c8_display_destroy();
+	c8_audio_destroy();
+	SDL_Quit();
+}
+
+int c8_daemon_run(const char* path, int workers, int window) {
+	pthread_t threads[workers];
+	int started;
+	int err;
+
+	if ((err = c8_daemon_listen(path)) != 0) {
+		return err;
+	}
+
+	c8_daemon_window = window;
+
+	for (started = 0; started < workers; started++) {
+		if ((err = pthread_create(&threads[started], NULL, c8_daemon_worker, NULL)) != 0) {
+			break;
+		}
+	}
+
+	if (started == 0) {
+		close(c8_daemon_socket);
+		unlink(path);
+		return err;
+	}
+
+	if (window) {
+		/* connections still open are dropped when the process exits */
+		c8_daemon_window_run();
+		shutdown(c8_daemon_socket, SHUT_RDWR);
+	} else {
+		for (int i = 0; i < started; i++) {
+			pthread_join(threads[i], NULL);
+		}
+	}
+
+	close(c8_daemon_socket);
+	unlink(path);
+
+	return 0;
+}
@@ -0,0 +1,402 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+#include "cpu.h"
+#include "mem.h"
+
+#define DEBUG_MAX_BREAKPOINTS 32
+#define DEBUG_MAX_WATCHPOINTS 32
+#define DEBUG_LINE_LENGTH 128
+#define DEBUG_DISASM_LENGTH 32
+#define DEBUG_DISASM_DEFAULT 10
+#define DEBUG_DUMP_DEFAULT 16
+#define DEBUG_ANY_ADDR 0xffff
+#define DEBUG_REG_I 0x10
+
+typedef enum {
+	C8_COND_NONE,
+	C8_COND_EQ,
+	C8_COND_NEQ,
+	C8_COND_LT,
+	C8_COND_GT,
+	C8_COND_LE,
+	C8_COND_GE
+} c8_debug_cond_op_t;
+
+typedef struct {
+	uint16_t addr;
+	uint8_t reg;
+	c8_debug_cond_op_t op;
+	uint16_t val;
+	uint8_t held;
+} c8_debug_breakpoint_t;
+
+typedef struct {
+	uint16_t addr;
+	uint16_t len;
+} c8_debug_watchpoint_t;
+
+static c8_debug_breakpoint_t c8_breakpoints[DEBUG_MAX_BREAKPOINTS];
+static int c8_breakpoint_count;
+static c8_debug_watchpoint_t c8_watchpoints[DEBUG_MAX_WATCHPOINTS];
+static int c8_watchpoint_count;
+static uint32_t c8_step_count;
+static int c8_watch_hit;
+
+int c8_debug_armed() {
+	return c8_step_count != 0 || c8_breakpoint_count != 0 || c8_watchpoint_count != 0;
+}
+
+/*
+ * Stops before the next instruction. Safe to call from outside the
+ * execution loop, e.g. on a hotkey.
+ */
+void c8_debug_break(c8_vm_t* vm) {
+	c8_step_count = 1;
+	c8_cpu_select(vm);
+}
+
+void c8_debug_watch(c8_vm_t* vm, uint16_t addr, uint8_t old_val, uint8_t new_val) {
+	for (int i = 0; i < c8_watchpoint_count; i++) {
+		if (addr >= c8_watchpoints[i].addr && addr < c8_watchpoints[i].addr + c8_watchpoints[i].len) {
+			printf("watchpoint 0x%03x: [0x%03x] 0x%02x -> 0x%02x at 0x%03x\n", c8_watchpoints[i].addr, addr, old_val, new_val,
+					(vm->c8_program_counter - 2) & (MEMORY_SIZE - 1));
+			c8_watch_hit = 1;
+		}
+	}
+}
+
+static uint16_t c8_debug_reg_value(c8_vm_t* vm, uint8_t reg) {
+	if (reg == DEBUG_REG_I) {
+		return vm->c8_immediate;
+	}
+
+	return vm->c8_registers[reg];
+}
+
+static int c8_debug_cond_holds(c8_vm_t* vm, c8_debug_breakpoint_t* bp) {
+	uint16_t a = c8_debug_reg_value(vm, bp->reg);
+
+	switch (bp->op) {
+		case C8_COND_NONE:
+			return 1;
+		case C8_COND_EQ:
+			return a == bp->val;
+		case C8_COND_NEQ:
+			return a != bp->val;
+		case C8_COND_LT:
+			return a < bp->val;
+		case C8_COND_GT:
+			return a > bp->val;
+		case C8_COND_LE:
+			return a <= bp->val;
+		case C8_COND_GE:
+			return a >= bp->val;
+		default:
+			return 0;
+	}
+}
+
+static uint16_t c8_debug_instr_at(c8_vm_t* vm, uint16_t addr) {
+	return c8_mem_read(vm, addr) << 8 | c8_mem_read(vm, addr + 1);
+}
+
+static void c8_debug_print_instr(c8_vm_t* vm, uint16_t addr) {
+	char text[DEBUG_DISASM_LENGTH];
+	uint16_t instr = c8_debug_instr_at(vm, addr);
+
+	c8_cpu_disasm(instr, text, DEBUG_DISASM_LENGTH);
+	printf("%c 0x%03x: %04x  %s\n", addr == vm->c8_program_counter ? '>' : ' ', addr, instr, text);
+}
+
+static void c8_debug_print_regs(c8_vm_t* vm) {
+	for (int i = 0; i < REGISTERS_COUNT; i++) {
+		printf("V%X=%02x%c", i, vm->c8_registers[i], (i % 8) == 7 ? '\n' : ' ');
+	}
+
+	printf("I=%03x PC=%03x SP=%x DT=%02x ST=%02x KEYS=%04x\n", vm->c8_immediate, vm->c8_program_counter,
+			vm->c8_stack_counter, vm->c8_delay_timer, vm->c8_sound_timer, vm->c8_keypad);
+}
+
+static void c8_debug_print_mem(c8_vm_t* vm, uint16_t addr, uint16_t len) {
+	for (uint16_t i = 0; i < len; i++) {
+		if ((i % 16) == 0) {
+			printf("%s0x%03x:", i ? "\n" : "", (addr + i) & (MEMORY_SIZE - 1));
+		}
+
+		printf(" %02x", c8_mem_read(vm, addr + i));
+	}
+
+	putchar('\n');
+}
+
+static int c8_debug_parse_reg(const char* s, uint8_t* reg) {
+	if ((s[0] == 'I' || s[0] == 'i') && s[1] == '\0') {
+		*reg = DEBUG_REG_I;
+		return 0;
+	}
+
+	if ((s[0] == 'V' || s[0] == 'v') && s[1] != '\0' && s[2] == '\0') {
+		char* end;
+		long r = strtol(&s[1], &end, 16);
+
+		if (*end == '\0') {
+			*reg = r;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static c8_debug_cond_op_t c8_debug_parse_op(const char* s) {
+	static const char* ops[] = { "", "==", "!=", "<", ">", "<=", ">=" };
+
+	for (int i = C8_COND_EQ; i <= C8_COND_GE; i++) {
+		if (strcmp(s, ops[i]) == 0) {
+			return i;
+		}
+	}
+
+	return C8_COND_NONE;
+}
+
+/*
+ * b ADDR|* [Vx|I OP VAL]
+ */
+static void c8_debug_add_breakpoint(char* args) {
+	char* addr_s = strtok(args, " \t");
+	char* reg_s = strtok(NULL, " \t");
+	char* op_s = strtok(NULL, " \t");
+	char* val_s = strtok(NULL, " \t");
+	c8_debug_breakpoint_t bp = { DEBUG_ANY_ADDR, 0, C8_COND_NONE, 0, 0 };
+
+	if (addr_s == NULL || c8_breakpoint_count == DEBUG_MAX_BREAKPOINTS) {
+		puts("usage: b ADDR|* [Vx|I OP VALUE]");
+		return;
+	}
+
+	if (strcmp(addr_s, "*") != 0) {
+		bp.addr = strtol(addr_s, NULL, 16) & (MEMORY_SIZE - 1);
+	}
+
+	if (reg_s != NULL) {
+		if (op_s == NULL || val_s == NULL || c8_debug_parse_reg(reg_s, &bp.reg) != 0 || (bp.op = c8_debug_parse_op(op_s)) == C8_COND_NONE) {
+			puts("usage: b ADDR|* [Vx|I OP VALUE]");
+			return;
+		}
+
+		bp.val = strtol(val_s, NULL, 16);
+	} else if (bp.addr == DEBUG_ANY_ADDR) {
+		puts("a breakpoint on * needs a condition");
+		return;
+	}
+
+	c8_breakpoints[c8_breakpoint_count++] = bp;
+}
+
+static void c8_debug_add_watchpoint(char* args) {
+	char* addr_s = strtok(args, " \t");
+	char* len_s = strtok(NULL, " \t");
+
+	if (addr_s == NULL || c8_watchpoint_count == DEBUG_MAX_WATCHPOINTS) {
+		puts("usage: w ADDR [LEN]");
+		return;
+	}
+
+	c8_watchpoints[c8_watchpoint_count].addr = strtol(addr_s, NULL, 16) & (MEMORY_SIZE - 1);
+	c8_watchpoints[c8_watchpoint_count].len = len_s != NULL ? strtol(len_s, NULL, 16) : 1;
+	c8_watchpoint_count++;
+}
+
+static void c8_debug_delete(char* args) {
+	char* addr_s = strtok(args, " \t");
+
+	if (addr_s == NULL) {
+		c8_breakpoint_count = 0;
+		c8_watchpoint_count = 0;
+		return;
+	}
+
+	uint16_t addr = strcmp(addr_s, "*") == 0 ? DEBUG_ANY_ADDR : strtol(addr_s, NULL, 16) & (MEMORY_SIZE - 1);
+
+	for (int i = c8_breakpoint_count - 1; i >= 0; i--) {
+		if (c8_breakpoints[i].addr == addr) {
+			c8_breakpoints[i] = c8_breakpoints[--c8_breakpoint_count];
+		}
+	}
+
+	for (int i = c8_watchpoint_count - 1; i >= 0; i--) {
+		if (c8_watchpoints[i].addr == addr) {
+			c8_watchpoints[i] = c8_watchpoints[--c8_watchpoint_count];
+		}
+	}
+}
+
+static void c8_debug_list() {
+	static const char* ops[] = { "", "==", "!=", "<", ">", "<=", ">=" };
+
+	for (int i = 0; i < c8_breakpoint_count; i++) {
+		c8_debug_breakpoint_t* bp = &c8_breakpoints[i];
+
+		if (bp->addr == DEBUG_ANY_ADDR) {
+			printf("break *");
+		} else {
+			printf("break 0x%03x", bp->addr);
+		}
+
+		if (bp->op != C8_COND_NONE) {
+			if (bp->reg == DEBUG_REG_I) {
+				printf(" if I %s 0x%x", ops[bp->op], bp->val);
+			} else {
+				printf(" if V%X %s 0x%x", bp->reg, ops[bp->op], bp->val);
+			}
+		}
+
+		putchar('\n');
+	}
+
+	for (int i = 0; i < c8_watchpoint_count; i++) {
+		printf("watch 0x%03x len %d\n", c8_watchpoints[i].addr, c8_watchpoints[i].len);
+	}
+}
+
+static void c8_debug_help() {
+	puts("c             continue");
+	puts("s [N]         step N instructions");
+	puts("b ADDR [COND] break at ADDR, optionally only if COND (e.g. V3 == 5)");
+	puts("b * COND      break anywhere COND holds");
+	puts("w ADDR [LEN]  break on writes to ADDR..ADDR+LEN");
+	puts("d [ADDR|*]    delete break/watchpoints at ADDR, or all");
+	puts("l             list break/watchpoints");
+	puts("r             show registers");
+	puts("x ADDR [LEN]  dump memory");
+	puts("u [ADDR] [N]  disassemble");
+	puts("q             quit");
+}
+
+/*
+ * Runs the interactive prompt. Returns when execution should resume.
+ */
+static void c8_debug_prompt(c8_vm_t* vm) {
+	char line[DEBUG_LINE_LENGTH];
+
+	c8_debug_print_instr(vm, vm->c8_program_counter);
+
+	for (;;) {
+		printf("(c8db) ");
+		fflush(stdout);
+
+		if (fgets(line, DEBUG_LINE_LENGTH, stdin) == NULL) {
+			vm->c8_run = 0;
+			return;
+		}
+
+		char* cmd = strtok(line, " \t\n");
+		char* args = strtok(NULL, "\n");
+
+		if (cmd == NULL) {
+			continue;
+		}
+
+		switch (cmd[0]) {
+			case 'c':
+				return;
+			case 's': {
+				char* end = NULL;
+				unsigned long count = args != NULL ? strtoul(args, &end, 10) : 1;
+
+				if (count == 0 || count > UINT32_MAX || (end != NULL && (args[strspn(args, " \t")] == '-' || end[strspn(end, " \t")] != '\0'))) {
+					c8_debug_help();
+					break;
+				}
+
+				c8_step_count = count;
+				return;
+			}
+			case 'b':
+				c8_debug_add_breakpoint(args != NULL ? args : "");
+				break;
+			case 'w':
+				c8_debug_add_watchpoint(args != NULL ? args : "");
+				break;
+			case 'd':
+				c8_debug_delete(args != NULL ? args : "");
+				break;
+			case 'l':
+				c8_debug_list();
+				break;
+			case 'r':
+				c8_debug_print_regs(vm);
+				break;
+			case 'x': {
+				char* addr_s = args != NULL ? strtok(args, " \t") : NULL;
+				char* len_s = strtok(NULL, " \t");
+
+				if (addr_s == NULL) {
+					puts("usage: x ADDR [LEN]");
+					break;
+				}
+
+				c8_debug_print_mem(vm, strtol(addr_s, NULL, 16), len_s != NULL ? strtol(len_s, NULL, 16) : DEBUG_DUMP_DEFAULT);
+				break;
+			}
+			case 'u': {
+				char* addr_s = args != NULL ? strtok(args, " \t") : NULL;
+				char* count_s = strtok(NULL, " \t");
+				uint16_t addr = addr_s != NULL ? strtol(addr_s, NULL, 16) : vm->c8_program_counter;
+				int count = count_s != NULL ? atoi(count_s) : DEBUG_DISASM_DEFAULT;
+
+				for (int i = 0; i < count; i++) {
+					c8_debug_print_instr(vm, addr + i * 2);
+				}
+				break;
+			}
+			case 'q':
+				vm->c8_run = 0;
+				return;
+			default:
+				c8_debug_help();
+				break;
+		}
+	}
+}
+
+/*
+ * Called by the instrumented interpreter before every instruction.
+ */
+void c8_debug_check(c8_vm_t* vm) {
+	int stop = c8_watch_hit;
+	c8_watch_hit = 0;
+
+	if (c8_step_count != 0 && --c8_step_count == 0) {
+		stop = 1;
+	}
+
+	for (int i = 0; i < c8_breakpoint_count; i++) {
+		c8_debug_breakpoint_t* bp = &c8_breakpoints[i];
+
+		if (bp->addr == DEBUG_ANY_ADDR) {
+			/* Anywhere-conditions only stop when they become true */
+			uint8_t held = c8_debug_cond_holds(vm, bp);
+			stop |= held && !bp->held;
+			bp->held = held;
+		} else if (bp->addr == vm->c8_program_counter && c8_debug_cond_holds(vm, bp)) {
+			stop = 1;
+		}
+	}
+
+	if (stop) {
+		c8_debug_prompt(vm);
+		c8_cpu_select(vm);
+	}
+}
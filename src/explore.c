@@ -0,0 +1,555 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "explore.h"
+#include "mem.h"
+
+#define EXPLORE_MAX_PROBES 64
+#define EXPLORE_HEAP_INITIAL 1024
+#define EXPLORE_NO_NODE UINT32_MAX
+
+typedef struct {
+	uint32_t parent;
+	uint16_t input;
+	uint16_t depth;
+} c8_explore_node_t;
+
+/*
+ * Open nodes carry no machine: it is replayed from the root along the
+ * node's inputs when the node is expanded, so the frontier costs a few
+ * bytes per state rather than a whole VM.
+ */
+typedef struct {
+	uint32_t node;
+	int score;
+} c8_explore_item_t;
+
+/*
+ * Siblings are usually expanded one after the other, so each worker
+ * keeps the last parent it replayed and only steps from it.
+ */
+typedef struct {
+	uint32_t node;
+	c8_vm_t vm;
+} c8_explore_cache_t;
+
+typedef struct {
+	const c8_explore_opts_t* opts;
+	const c8_vm_t* root;
+
+	uint64_t* table;
+	uint64_t table_mask;
+
+	c8_explore_node_t* nodes;
+	uint32_t node_count;
+
+	c8_explore_item_t* frontier;
+	uint32_t frontier_count;
+	uint32_t frontier_next;
+	c8_explore_item_t* next;
+	uint32_t next_count;
+
+	c8_explore_item_t* heap;
+	uint32_t heap_count;
+	uint32_t heap_capacity;
+	int busy;
+
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	int best_score;
+	uint32_t best_node;
+	int found;
+	int error;
+	uint64_t expanded;
+	uint64_t duplicates;
+} c8_explorer_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t registers[REGISTERS_COUNT];
+	uint16_t immediate;
+	uint16_t program_counter;
+	uint8_t stack_counter;
+	uint8_t delay_timer;
+	uint8_t sound_timer;
+	uint32_t rng;
+	int32_t cycle_budget;
+	uint16_t stack[STACK_SIZE];
+} c8_explore_state_t;
+
+/*
+ * The keypad is left out: the explorer sets it before every step, so
+ * states reached with different last keys are the same. Unused stack
+ * slots are left out too, stale return addresses don't split states.
+ */
+uint64_t c8_explore_hash(const c8_vm_t* vm) {
+	c8_explore_state_t state;
+	uint8_t sp = vm->c8_stack_counter < STACK_SIZE ? vm->c8_stack_counter : STACK_SIZE;
+
+	memset(&state, 0, sizeof(state));
+	memcpy(state.registers, vm->c8_registers, REGISTERS_COUNT);
+	state.immediate = vm->c8_immediate;
+	state.program_counter = vm->c8_program_counter;
+	state.stack_counter = vm->c8_stack_counter;
+	state.delay_timer = vm->c8_delay_timer;
+	state.sound_timer = vm->c8_sound_timer;
+	state.rng = vm->c8_rng;
+	state.cycle_budget = vm->c8_cycle_budget;
+	memcpy(state.stack, vm->c8_stack, sp * sizeof(uint16_t));
+
+	uint64_t h = c8_mem_hash(vm);
+	h = c8_mem_hash_bytes(&state, sizeof(state), h);
+
+	return c8_mem_hash_bytes(vm->c8_frame_buffer, FRAME_BUFFER_SIZE, h);
+}
+
+/*
+ * Lock-free open addressing set. Returns 1 if the key was added, 0 if it
+ * was already present. A full neighbourhood counts as new: the state is
+ * explored again rather than wrongly pruned.
+ */
+static int c8_explore_table_insert(c8_explorer_t* ex, uint64_t key) {
+	key += key == 0;
+	uint64_t i = key & ex->table_mask;
+
+	for (int probe = 0; probe < EXPLORE_MAX_PROBES; probe++) {
+		uint64_t expected = 0;
+
+		if (__atomic_compare_exchange_n(&ex->table[i], &expected, key, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			return 1;
+		}
+
+		if (expected == key) {
+			return 0;
+		}
+
+		i = (i + 1) & ex->table_mask;
+	}
+
+	return 1;
+}
+
+static int c8_explore_better(const c8_explore_item_t* a, const c8_explore_item_t* b, c8_explorer_t* ex) {
+	if (a->score != b->score) {
+		return a->score > b->score;
+	}
+
+	return ex->nodes[a->node].depth < ex->nodes[b->node].depth;
+}
+
+/*
+ * Caller holds ex->lock.
+ */
+static int c8_explore_heap_push(c8_explorer_t* ex, const c8_explore_item_t* item) {
+	if (ex->heap_count == ex->heap_capacity) {
+		uint32_t capacity = ex->heap_capacity ? ex->heap_capacity * 2 : EXPLORE_HEAP_INITIAL;
+		c8_explore_item_t* heap = realloc(ex->heap, capacity * sizeof(c8_explore_item_t));
+
+		if (heap == NULL) {
+			return ENOMEM;
+		}
+
+		ex->heap = heap;
+		ex->heap_capacity = capacity;
+	}
+
+	uint32_t i = ex->heap_count++;
+
+	while (i > 0 && c8_explore_better(item, &ex->heap[(i - 1) / 2], ex)) {
+		ex->heap[i] = ex->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+
+	ex->heap[i] = *item;
+
+	return 0;
+}
+
+/*
+ * Caller holds ex->lock.
+ */
+static void c8_explore_heap_pop(c8_explorer_t* ex, c8_explore_item_t* item) {
+	*item = ex->heap[0];
+	c8_explore_item_t last = ex->heap[--ex->heap_count];
+	uint32_t i = 0;
+
+	for (;;) {
+		uint32_t child = i * 2 + 1;
+
+		if (child >= ex->heap_count) {
+			break;
+		}
+
+		if (child + 1 < ex->heap_count && c8_explore_better(&ex->heap[child + 1], &ex->heap[child], ex)) {
+			child++;
+		}
+
+		if (!c8_explore_better(&ex->heap[child], &last, ex)) {
+			break;
+		}
+
+		ex->heap[i] = ex->heap[child];
+		i = child;
+	}
+
+	if (ex->heap_count != 0) {
+		ex->heap[i] = last;
+	}
+}
+
+static void c8_explore_record_score(c8_explorer_t* ex, uint32_t node, int score) {
+	if (score <= __atomic_load_n(&ex->best_score, __ATOMIC_RELAXED) && score < ex->opts->goal) {
+		return;
+	}
+
+	pthread_mutex_lock(&ex->lock);
+
+	if (!ex->found && (score > ex->best_score || score >= ex->opts->goal)) {
+		__atomic_store_n(&ex->best_score, score, __ATOMIC_RELAXED);
+		ex->best_node = node;
+	}
+
+	if (!ex->found && score >= ex->opts->goal) {
+		__atomic_store_n(&ex->found, 1, __ATOMIC_RELAXED);
+		pthread_cond_broadcast(&ex->wake);
+	}
+
+	pthread_mutex_unlock(&ex->lock);
+}
+
+static void c8_explore_step(c8_explorer_t* ex, c8_vm_t* vm, uint16_t keypad) {
+	vm->c8_keypad = keypad;
+
+	for (int f = 0; f < ex->opts->frames_per_step && vm->c8_run; f++) {
+		c8_vm_frame(vm, NULL);
+	}
+}
+
+/*
+ * Rebuilds the machine of node by running its inputs from the root.
+ */
+static void c8_explore_replay_path(c8_explorer_t* ex, uint32_t node, c8_vm_t* vm) {
+	uint16_t depth = ex->nodes[node].depth;
+	uint16_t inputs[depth + 1];
+
+	for (uint32_t n = node; n != 0; n = ex->nodes[n].parent) {
+		inputs[ex->nodes[n].depth - 1] = ex->nodes[n].input;
+	}
+
+	c8_mem_clone(vm, ex->root);
+
+	for (uint16_t d = 0; d < depth; d++) {
+		c8_explore_step(ex, vm, inputs[d]);
+	}
+}
+
+static void c8_explore_replay(c8_explorer_t* ex, c8_explore_cache_t* cache, uint32_t node, c8_vm_t* vm) {
+	if (node == 0) {
+		c8_mem_clone(vm, ex->root);
+		return;
+	}
+
+	uint32_t parent = ex->nodes[node].parent;
+
+	if (cache->node != parent) {
+		if (cache->node != EXPLORE_NO_NODE) {
+			c8_vm_destroy(&cache->vm);
+		}
+
+		c8_explore_replay_path(ex, parent, &cache->vm);
+		cache->node = parent;
+	}
+
+	c8_mem_clone(vm, &cache->vm);
+	c8_explore_step(ex, vm, ex->nodes[node].input);
+}
+
+static void c8_explore_cache_destroy(c8_explore_cache_t* cache) {
+	if (cache->node != EXPLORE_NO_NODE) {
+		c8_vm_destroy(&cache->vm);
+	}
+}
+
+/*
+ * Runs every input choice from item for frames_per_step frames and hands
+ * the children that were not seen before to emit.
+ */
+static void c8_explore_expand(c8_explorer_t* ex, c8_explore_cache_t* cache, c8_explore_item_t* item, void (*emit)(c8_explorer_t* ex, c8_explore_item_t* child)) {
+	uint16_t depth = ex->nodes[item->node].depth;
+	c8_vm_t parent;
+
+	__atomic_add_fetch(&ex->expanded, 1, __ATOMIC_RELAXED);
+	c8_explore_replay(ex, cache, item->node, &parent);
+
+	for (int input = 0; input < C8_EXPLORE_INPUTS && !__atomic_load_n(&ex->found, __ATOMIC_RELAXED); input++) {
+		c8_explore_item_t child;
+		c8_vm_t vm;
+		uint16_t keypad = input ? 1 << (input - 1) : 0;
+
+		c8_mem_clone(&vm, &parent);
+		c8_explore_step(ex, &vm, keypad);
+
+		if (!c8_explore_table_insert(ex, c8_explore_hash(&vm))) {
+			__atomic_add_fetch(&ex->duplicates, 1, __ATOMIC_RELAXED);
+			c8_vm_destroy(&vm);
+			continue;
+		}
+
+		child.node = __atomic_fetch_add(&ex->node_count, 1, __ATOMIC_RELAXED);
+
+		if (child.node >= ex->opts->max_nodes) {
+			c8_vm_destroy(&vm);
+			continue;
+		}
+
+		ex->nodes[child.node].parent = item->node;
+		ex->nodes[child.node].input = keypad;
+		ex->nodes[child.node].depth = depth + 1;
+		child.score = ex->opts->score(&vm, ex->opts->user);
+		c8_explore_record_score(ex, child.node, child.score);
+		c8_vm_destroy(&vm);
+
+		emit(ex, &child);
+	}
+
+	c8_vm_destroy(&parent);
+}
+
+/*
+ * Runs worker on opts->threads threads and waits for them. If not a
+ * single thread can be started the caller runs it alone.
+ */
+static void c8_explore_run_workers(c8_explorer_t* ex, void* (*worker)(void* arg)) {
+	pthread_t threads[ex->opts->threads];
+	int started = 0;
+
+	while (started < ex->opts->threads && pthread_create(&threads[started], NULL, worker, ex) == 0) {
+		started++;
+	}
+
+	if (started == 0) {
+		worker(ex);
+	}
+
+	for (int t = 0; t < started; t++) {
+		pthread_join(threads[t], NULL);
+	}
+}
+
+static void c8_explore_emit_level(c8_explorer_t* ex, c8_explore_item_t* child) {
+	uint32_t i = __atomic_fetch_add(&ex->next_count, 1, __ATOMIC_RELAXED);
+	ex->next[i] = *child;
+}
+
+static void* c8_explore_bfs_worker(void* arg) {
+	c8_explorer_t* ex = arg;
+	c8_explore_cache_t cache = { .node = EXPLORE_NO_NODE };
+	uint32_t i;
+
+	while ((i = __atomic_fetch_add(&ex->frontier_next, 1, __ATOMIC_RELAXED)) < ex->frontier_count) {
+		if (!__atomic_load_n(&ex->found, __ATOMIC_RELAXED)) {
+			c8_explore_expand(ex, &cache, &ex->frontier[i], c8_explore_emit_level);
+		}
+	}
+
+	c8_explore_cache_destroy(&cache);
+
+	return NULL;
+}
+
+static int c8_explore_nodes_left(c8_explorer_t* ex) {
+	return __atomic_load_n(&ex->node_count, __ATOMIC_RELAXED) < ex->opts->max_nodes;
+}
+
+/*
+ * Level-synchronous breadth first search: the workers share the current
+ * level through an atomic cursor and append to the next one.
+ */
+static int c8_explore_bfs(c8_explorer_t* ex, c8_explore_item_t* root) {
+	ex->frontier = malloc(sizeof(c8_explore_item_t));
+
+	if (ex->frontier == NULL) {
+		return ENOMEM;
+	}
+
+	ex->frontier[0] = *root;
+	ex->frontier_count = 1;
+
+	for (int depth = 0; depth < ex->opts->max_depth && ex->frontier_count != 0 && !ex->found && c8_explore_nodes_left(ex); depth++) {
+		uint64_t capacity = (uint64_t) ex->frontier_count * C8_EXPLORE_INPUTS;
+		uint64_t left = ex->opts->max_nodes - ex->node_count;
+
+		if (capacity > left) {
+			capacity = left;
+		}
+
+		if ((ex->next = malloc(capacity * sizeof(c8_explore_item_t))) == NULL) {
+			ex->error = ENOMEM;
+			break;
+		}
+
+		ex->next_count = 0;
+		ex->frontier_next = 0;
+
+		c8_explore_run_workers(ex, c8_explore_bfs_worker);
+
+		free(ex->frontier);
+		ex->frontier = ex->next;
+		ex->frontier_count = ex->next_count;
+		ex->next = NULL;
+	}
+
+	free(ex->frontier);
+	ex->frontier = NULL;
+
+	return ex->error;
+}
+
+static void c8_explore_emit_heap(c8_explorer_t* ex, c8_explore_item_t* child) {
+	pthread_mutex_lock(&ex->lock);
+
+	if (ex->nodes[child->node].depth < ex->opts->max_depth && c8_explore_heap_push(ex, child) == 0) {
+		pthread_cond_signal(&ex->wake);
+	}
+
+	pthread_mutex_unlock(&ex->lock);
+}
+
+/*
+ * Best first: workers pop the highest scoring open node. The search is
+ * over once the goal is reached, the node budget is spent or the heap is
+ * empty with no worker left that could refill it.
+ */
+static void* c8_explore_best_worker(void* arg) {
+	c8_explorer_t* ex = arg;
+	c8_explore_cache_t cache = { .node = EXPLORE_NO_NODE };
+	c8_explore_item_t item;
+
+	pthread_mutex_lock(&ex->lock);
+
+	for (;;) {
+		while (ex->heap_count == 0 && ex->busy != 0 && !ex->found) {
+			pthread_cond_wait(&ex->wake, &ex->lock);
+		}
+
+		if (ex->found || ex->heap_count == 0 || !c8_explore_nodes_left(ex)) {
+			break;
+		}
+
+		c8_explore_heap_pop(ex, &item);
+		ex->busy++;
+		pthread_mutex_unlock(&ex->lock);
+
+		c8_explore_expand(ex, &cache, &item, c8_explore_emit_heap);
+
+		pthread_mutex_lock(&ex->lock);
+		ex->busy--;
+
+		if (ex->heap_count == 0 && ex->busy == 0) {
+			pthread_cond_broadcast(&ex->wake);
+		}
+	}
+
+	pthread_cond_broadcast(&ex->wake);
+	pthread_mutex_unlock(&ex->lock);
+	c8_explore_cache_destroy(&cache);
+
+	return NULL;
+}
+
+static int c8_explore_best(c8_explorer_t* ex, c8_explore_item_t* root) {
+	if (c8_explore_heap_push(ex, root) != 0) {
+		return ENOMEM;
+	}
+
+	c8_explore_run_workers(ex, c8_explore_best_worker);
+	free(ex->heap);
+
+	return 0;
+}
+
+/*
+ * Searches for the input sequence, one keypad state held for
+ * frames_per_step frames per step, that reaches opts->goal, or failing
+ * that the best score seen. root is left untouched.
+ */
+int c8_explore(const c8_vm_t* root, const c8_explore_opts_t* opts, c8_explore_result_t* result) {
+	c8_explorer_t ex;
+	c8_explore_item_t start;
+	c8_vm_t vm;
+	int err;
+
+	memset(&ex, 0, sizeof(ex));
+	memset(result, 0, sizeof(*result));
+	ex.opts = opts;
+	ex.root = root;
+	ex.table_mask = (1ULL << opts->table_bits) - 1;
+	ex.table = calloc(ex.table_mask + 1, sizeof(uint64_t));
+	ex.nodes = malloc(opts->max_nodes * sizeof(c8_explore_node_t));
+
+	if (ex.table == NULL || ex.nodes == NULL || opts->max_nodes == 0 || opts->threads < 1) {
+		free(ex.table);
+		free(ex.nodes);
+		return ENOMEM;
+	}
+
+	pthread_mutex_init(&ex.lock, NULL);
+	pthread_cond_init(&ex.wake, NULL);
+
+	c8_mem_clone(&vm, root);
+	start.node = ex.node_count++;
+	start.score = opts->score(&vm, opts->user);
+	ex.nodes[0].parent = 0;
+	ex.nodes[0].input = 0;
+	ex.nodes[0].depth = 0;
+	ex.best_score = start.score;
+	ex.best_node = 0;
+	ex.found = start.score >= opts->goal;
+	c8_explore_table_insert(&ex, c8_explore_hash(&vm));
+	c8_vm_destroy(&vm);
+
+	if (opts->best_first) {
+		err = c8_explore_best(&ex, &start);
+	} else {
+		err = c8_explore_bfs(&ex, &start);
+	}
+
+	if (err == 0) {
+		uint16_t depth = ex.nodes[ex.best_node].depth;
+
+		result->found = ex.found;
+		result->score = ex.best_score;
+		result->depth = depth;
+		result->expanded = ex.expanded;
+		result->duplicates = ex.duplicates;
+		result->inputs = malloc((depth + 1) * sizeof(uint16_t));
+
+		if (result->inputs == NULL) {
+			err = ENOMEM;
+		} else {
+			for (uint32_t n = ex.best_node; n != 0; n = ex.nodes[n].parent) {
+				result->inputs[ex.nodes[n].depth - 1] = ex.nodes[n].input;
+			}
+		}
+	}
+
+	pthread_cond_destroy(&ex.wake);
+	pthread_mutex_destroy(&ex.lock);
+	free(ex.table);
+	free(ex.nodes);
+
+	return err;
+}
+
+void c8_explore_result_free(c8_explore_result_t* result) {
+	free(result->inputs);
+	result->inputs = NULL;
+}
@@ -8,6 +8,8 @@
 
 #include <SDL2/SDL.h>
 #include "keypad.h"
+#include "debug.h"
+#include "metrics.h"
 
 #define KEYMAP_SIZE 16
 
@@ -34,17 +36,26 @@ int c8_keypad_scan(c8_vm_t* vm) {
     while (SDL_PollEvent(&e)){
         if (e.type == SDL_QUIT) {
             vm->c8_run = 0;
+        } else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F12) {
+        	c8_debug_break(vm);
+        } else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F11) {
+        	c8_metrics_toggle_overlay();
         } else if (e.type == SDL_KEYDOWN) {
         	int k = c8_get_key(e.key.keysym.sym);
 
             if (k != -1) {
             	vm->c8_keypad |= (1 << k);
+
+            	if (!e.key.repeat) {
+            		c8_metrics_input(e.key.timestamp);
+            	}
             }
         } else if (e.type == SDL_KEYUP) {
         	int k = c8_get_key(e.key.keysym.sym);
 
         	if (k != -1) {
         		vm->c8_keypad &= ~(1 << k);
+        		c8_metrics_input(e.key.timestamp);
         	}
         }
     }
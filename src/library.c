@@ -0,0 +1,427 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "library.h"
+
+#define LIBRARY_INDEX_NAME ".chipollotto-index"
+#define LIBRARY_INDEX_HEADER "chipollotto-index 1"
+#define LIBRARY_LINE_LENGTH (C8_ROM_NAME_MAX + 64)
+#define LIBRARY_INITIAL_CAPACITY 64
+#define LIBRARY_SKIP_EXT ".quirks"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static const char* c8_platform_names[] = { "chip8", "schip", "xochip" };
+
+const char* c8_platform_name(uint8_t platform) {
+	if (platform > C8_PLATFORM_XOCHIP) {
+		return "unknown";
+	}
+
+	return c8_platform_names[platform];
+}
+
+static int c8_platform_from_name(const char* name) {
+	for (int i = C8_PLATFORM_CHIP8; i <= C8_PLATFORM_XOCHIP; i++) {
+		if (strcmp(name, c8_platform_names[i]) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Maps a ROM read-only. Fails with EFBIG if it would not fit between the
+ * load address and the end of memory.
+ */
+int c8_rom_map(const char* path, c8_rom_t* rom) {
+	int fd = open(path, O_RDONLY);
+
+	if (fd == -1) {
+		return errno;
+	}
+
+	struct stat file_info;
+
+	if (fstat(fd, &file_info) == -1) {
+		int err = errno;
+		close(fd);
+		return err;
+	}
+
+	if (!S_ISREG(file_info.st_mode) || file_info.st_size == 0) {
+		close(fd);
+		return EINVAL;
+	}
+
+	if (file_info.st_size > C8_ROM_MAX_SIZE) {
+		close(fd);
+		return EFBIG;
+	}
+
+	void* data = mmap(NULL, file_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED) {
+		return errno;
+	}
+
+	rom->data = data;
+	rom->size = file_info.st_size;
+
+	return 0;
+}
+
+void c8_rom_unmap(c8_rom_t* rom) {
+	munmap((void *) rom->data, rom->size);
+	rom->data = NULL;
+	rom->size = 0;
+}
+
+uint64_t c8_rom_hash(const uint8_t* data, size_t size) {
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/*
+ * Static opcode scan. Data mixed into the code gives false hits, so the
+ * result is only a default which -q or a .quirks profile overrides.
+ */
+void c8_rom_detect(const uint8_t* data, size_t size, uint8_t* platform, uint8_t* quirks) {
+	int schip = 0;
+	int xochip = 0;
+
+	for (size_t i = 0; i + 1 < size; i += 2) {
+		uint16_t instr = data[i] << 8 | data[i + 1];
+		uint8_t lo = instr & 0xff;
+
+		switch (instr & 0xf000) {
+			case 0x0000:
+				if (instr == 0x00fb || instr == 0x00fc || instr == 0x00fd || instr == 0x00fe || instr == 0x00ff || (instr & 0xfff0) == 0x00c0) {
+					schip++;
+				} else if ((instr & 0xfff0) == 0x00d0) {
+					xochip++;
+				}
+				break;
+			case 0x5000:
+				if ((instr & 0x000f) == 0x2 || (instr & 0x000f) == 0x3) {
+					xochip++;
+				}
+				break;
+			case 0xf000:
+				if (instr == 0xf000 || instr == 0xf002 || (lo == 0x01 && (instr & 0x0c00) == 0) || lo == 0x3a) {
+					xochip++;
+				} else if (lo == 0x30 || lo == 0x75 || lo == 0x85) {
+					schip++;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (xochip > 1) {
+		*platform = C8_PLATFORM_XOCHIP;
+		*quirks = 0;
+	} else if (schip > 1) {
+		*platform = C8_PLATFORM_SCHIP;
+		*quirks = C8_QUIRK_SHIFT | C8_QUIRK_LOAD | C8_QUIRK_CLIP | C8_QUIRK_JUMP;
+	} else {
+		*platform = C8_PLATFORM_CHIP8;
+		*quirks = 0;
+	}
+}
+
+static int c8_entry_cmp(const void* a, const void* b) {
+	return strcmp(((const c8_rom_entry_t *) a)->name, ((const c8_rom_entry_t *) b)->name);
+}
+
+static c8_rom_entry_t* c8_library_add(c8_library_t* lib) {
+	if (lib->count == lib->capacity) {
+		int capacity = lib->capacity ? lib->capacity * 2 : LIBRARY_INITIAL_CAPACITY;
+		c8_rom_entry_t* entries = realloc(lib->entries, capacity * sizeof(c8_rom_entry_t));
+
+		if (entries == NULL) {
+			return NULL;
+		}
+
+		lib->entries = entries;
+		lib->capacity = capacity;
+	}
+
+	return &lib->entries[lib->count++];
+}
+
+static int c8_library_read_index(c8_library_t* lib) {
+	char path[PATH_MAX];
+	char line[LIBRARY_LINE_LENGTH];
+
+	if (snprintf(path, PATH_MAX, "%s/%s", lib->dir, LIBRARY_INDEX_NAME) >= PATH_MAX) {
+		return ENAMETOOLONG;
+	}
+
+	FILE* f = fopen(path, "r");
+
+	if (f == NULL) {
+		return errno;
+	}
+
+	if (fgets(line, LIBRARY_LINE_LENGTH, f) == NULL || strncmp(line, LIBRARY_INDEX_HEADER, strlen(LIBRARY_INDEX_HEADER)) != 0) {
+		fclose(f);
+		return EINVAL;
+	}
+
+	while (fgets(line, LIBRARY_LINE_LENGTH, f) != NULL) {
+		c8_rom_entry_t e;
+		char platform[8];
+		unsigned int quirks;
+		int name_off;
+
+		line[strcspn(line, "\n")] = '\0';
+
+		if (sscanf(line, "%" SCNx64 " %" SCNu32 " %" SCNd64 " %7s %x %n", &e.hash, &e.size, &e.mtime, platform, &quirks, &name_off) != 5) {
+			continue;
+		}
+
+		int p = c8_platform_from_name(platform);
+
+		if (p == -1 || line[name_off] == '\0') {
+			continue;
+		}
+
+		e.platform = p;
+		e.quirks = quirks & C8_QUIRK_MASK;
+		strncpy(e.name, &line[name_off], C8_ROM_NAME_MAX - 1);
+		e.name[C8_ROM_NAME_MAX - 1] = '\0';
+
+		c8_rom_entry_t* slot = c8_library_add(lib);
+
+		if (slot == NULL) {
+			fclose(f);
+			return ENOMEM;
+		}
+
+		*slot = e;
+	}
+
+	fclose(f);
+	qsort(lib->entries, lib->count, sizeof(c8_rom_entry_t), c8_entry_cmp);
+
+	return 0;
+}
+
+static int c8_library_write_index(c8_library_t* lib) {
+	char path[PATH_MAX];
+	char tmp_path[PATH_MAX];
+
+	if (snprintf(path, PATH_MAX, "%s/%s", lib->dir, LIBRARY_INDEX_NAME) >= PATH_MAX
+			|| snprintf(tmp_path, PATH_MAX, "%s.tmp", path) >= PATH_MAX) {
+		return ENAMETOOLONG;
+	}
+
+	FILE* f = fopen(tmp_path, "w");
+
+	if (f == NULL) {
+		return errno;
+	}
+
+	fprintf(f, "%s\n", LIBRARY_INDEX_HEADER);
+
+	for (int i = 0; i < lib->count; i++) {
+		c8_rom_entry_t* e = &lib->entries[i];
+		fprintf(f, "%016" PRIx64 " %" PRIu32 " %" PRId64 " %s %02x %s\n", e->hash, e->size, e->mtime,
+				c8_platform_name(e->platform), e->quirks, e->name);
+	}
+
+	if (fclose(f) != 0 || rename(tmp_path, path) != 0) {
+		int err = errno;
+		unlink(tmp_path);
+		return err;
+	}
+
+	return 0;
+}
+
+static int c8_library_scan_entry(c8_library_t* lib, c8_rom_entry_t* e) {
+	char path[PATH_MAX];
+	c8_rom_t rom;
+
+	int err = c8_library_path(lib, e, path, PATH_MAX);
+
+	if (err != 0 || (err = c8_rom_map(path, &rom)) != 0) {
+		return err;
+	}
+
+	e->hash = c8_rom_hash(rom.data, rom.size);
+	c8_rom_detect(rom.data, rom.size, &e->platform, &e->quirks);
+	c8_rom_unmap(&rom);
+
+	return 0;
+}
+
+/*
+ * Loads the directory index and brings it up to date. Only files whose
+ * size or modification time changed since the last scan are read again,
+ * and the index file is rewritten only if something changed.
+ */
+int c8_library_open(c8_library_t* lib, const char* dir) {
+	memset(lib, 0, sizeof(*lib));
+
+	if (snprintf(lib->dir, PATH_MAX, "%s", dir) >= PATH_MAX) {
+		return ENAMETOOLONG;
+	}
+
+	c8_library_t old;
+	memcpy(&old, lib, sizeof(old));
+	int err = c8_library_read_index(&old);
+	int changed = err != 0;
+
+	DIR* d = opendir(dir);
+
+	if (d == NULL) {
+		err = errno;
+		free(old.entries);
+		return err;
+	}
+
+	struct dirent* de;
+
+	while ((de = readdir(d)) != NULL) {
+		size_t name_len = strlen(de->d_name);
+		struct stat file_info;
+
+		if (de->d_name[0] == '.' || name_len >= C8_ROM_NAME_MAX) {
+			continue;
+		}
+
+		if (name_len > strlen(LIBRARY_SKIP_EXT) && strcmp(&de->d_name[name_len - strlen(LIBRARY_SKIP_EXT)], LIBRARY_SKIP_EXT) == 0) {
+			continue;
+		}
+
+		if (fstatat(dirfd(d), de->d_name, &file_info, 0) == -1 || !S_ISREG(file_info.st_mode)) {
+			continue;
+		}
+
+		if (file_info.st_size == 0 || file_info.st_size > C8_ROM_MAX_SIZE) {
+			continue;
+		}
+
+		c8_rom_entry_t* e = c8_library_add(lib);
+
+		if (e == NULL) {
+			closedir(d);
+			free(old.entries);
+			return ENOMEM;
+		}
+
+		memset(e, 0, sizeof(*e));
+		memcpy(e->name, de->d_name, name_len + 1);
+		e->size = file_info.st_size;
+		e->mtime = file_info.st_mtime;
+
+		c8_rom_entry_t* prev = bsearch(e, old.entries, old.count, sizeof(c8_rom_entry_t), c8_entry_cmp);
+
+		if (prev != NULL && prev->size == e->size && prev->mtime == e->mtime) {
+			*e = *prev;
+			continue;
+		}
+
+		changed = 1;
+
+		if (c8_library_scan_entry(lib, e) != 0) {
+			lib->count--;
+		}
+	}
+
+	closedir(d);
+	changed |= lib->count != old.count;
+	free(old.entries);
+
+	qsort(lib->entries, lib->count, sizeof(c8_rom_entry_t), c8_entry_cmp);
+
+	/* the index is only a cache, a read-only directory is still usable */
+	if (changed) {
+		c8_library_write_index(lib);
+	}
+
+	return 0;
+}
+
+/*
+ * Looks up a ROM by file name, or by a prefix of its hex content hash.
+ * Returns ENOENT if nothing matches and EEXIST if the prefix matches ROMs
+ * with different contents; copies of one ROM count as a single match.
+ */
+int c8_library_find(c8_library_t* lib, const char* name, c8_rom_entry_t** entry) {
+	c8_rom_entry_t key;
+
+	strncpy(key.name, name, C8_ROM_NAME_MAX - 1);
+	key.name[C8_ROM_NAME_MAX - 1] = '\0';
+
+	*entry = bsearch(&key, lib->entries, lib->count, sizeof(c8_rom_entry_t), c8_entry_cmp);
+
+	if (*entry != NULL) {
+		return 0;
+	}
+
+	size_t prefix_len = strlen(name);
+
+	if (prefix_len == 0 || prefix_len > 16 || strspn(name, "0123456789abcdef") != prefix_len) {
+		return ENOENT;
+	}
+
+	for (int i = 0; i < lib->count; i++) {
+		char hash[17];
+		snprintf(hash, sizeof(hash), "%016" PRIx64, lib->entries[i].hash);
+
+		if (strncmp(hash, name, prefix_len) == 0) {
+			if (*entry == NULL) {
+				*entry = &lib->entries[i];
+			} else if ((*entry)->hash != lib->entries[i].hash) {
+				*entry = NULL;
+				return EEXIST;
+			}
+		}
+	}
+
+	return *entry != NULL ? 0 : ENOENT;
+}
+
+int c8_library_path(c8_library_t* lib, c8_rom_entry_t* entry, char* path, size_t len) {
+	if ((size_t) snprintf(path, len, "%s/%s", lib->dir, entry->name) >= len) {
+		return ENAMETOOLONG;
+	}
+
+	return 0;
+}
+
+void c8_library_close(c8_library_t* lib) {
+	free(lib->entries);
+	lib->entries = NULL;
+	lib->count = 0;
+	lib->capacity = 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "mem.h"
+
+#define HASH_MULTIPLIER 0x9e3779b97f4a7c15ULL
+
+const uint8_t c8_font[FONT_ARR_LENGTH] = {
+		0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+		0x20, 0x60, 0x20, 0x20, 0x70, // 1
+		0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+		0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+		0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+		0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+		0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+		0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+		0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+		0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+		0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+		0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+		0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+		0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+		0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+		0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+/*
+ * Shared by every all-zero page of every image. It is never freed, so it
+ * isn't reference counted either: its count stays at 2, which makes every
+ * write copy it, and cloning doesn't contend on it across threads.
+ */
+static c8_page_t c8_zero_page = { 2, 0, { 0 } };
+
+static void c8_page_retain(c8_page_t* page) {
+	if (page != &c8_zero_page) {
+		__atomic_add_fetch(&page->c8_refs, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static void c8_page_release(c8_page_t* page) {
+	if (page != &c8_zero_page && __atomic_sub_fetch(&page->c8_refs, 1, __ATOMIC_ACQ_REL) == 0) {
+		free(page);
+	}
+}
+
+static c8_page_t* c8_page_alloc() {
+	return aligned_alloc(C8_CACHE_LINE, sizeof(c8_page_t));
+}
+
+static int c8_page_is_zero(const uint8_t* data) {
+	for (int i = 0; i < C8_PAGE_SIZE; i++) {
+		if (data[i] != 0) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Builds the initial memory of a ROM: font at FONT_ADDR and the program at
+ * PROGRAMM_LOAD_ADDR. Instances attached to the image share its pages.
+ */
+int c8_mem_image_create(c8_image_t* image, const uint8_t* rom, size_t size) {
+	uint8_t memory[MEMORY_SIZE];
+
+	if (size > MEMORY_SIZE - PROGRAMM_LOAD_ADDR) {
+		return EFBIG;
+	}
+
+	memset(memory, 0, MEMORY_SIZE);
+	memcpy(&memory[FONT_ADDR], c8_font, FONT_ARR_LENGTH);
+	memcpy(&memory[PROGRAMM_LOAD_ADDR], rom, size);
+
+	for (int i = 0; i < C8_PAGE_COUNT; i++) {
+		const uint8_t* data = &memory[i << C8_PAGE_SHIFT];
+
+		if (c8_page_is_zero(data)) {
+			image->c8_pages[i] = &c8_zero_page;
+			continue;
+		}
+
+		if ((image->c8_pages[i] = c8_page_alloc()) == NULL) {
+			while (i-- > 0) {
+				c8_page_release(image->c8_pages[i]);
+			}
+
+			return ENOMEM;
+		}
+
+		image->c8_pages[i]->c8_refs = 1;
+		image->c8_pages[i]->c8_hash = 0;
+		memcpy(image->c8_pages[i]->c8_data, data, C8_PAGE_SIZE);
+	}
+
+	return 0;
+}
+
+void c8_mem_image_destroy(c8_image_t* image) {
+	for (int i = 0; i < C8_PAGE_COUNT; i++) {
+		c8_page_release(image->c8_pages[i]);
+		image->c8_pages[i] = NULL;
+	}
+}
+
+void c8_mem_attach(c8_vm_t* vm, const c8_image_t* image) {
+	for (int i = 0; i < C8_PAGE_COUNT; i++) {
+		c8_page_retain(image->c8_pages[i]);
+		vm->c8_pages[i] = image->c8_pages[i];
+	}
+}
+
+/*
+ * Copies the whole instance. Memory is shared with src until either side
+ * writes to it, so this costs the size of c8_vm_t plus the page refcounts.
+ */
+void c8_mem_clone(c8_vm_t* dst, const c8_vm_t* src) {
+	memcpy(dst, src, sizeof(c8_vm_t));
+
+	for (int i = 0; i < C8_PAGE_COUNT; i++) {
+		c8_page_retain(dst->c8_pages[i]);
+	}
+}
+
+void c8_mem_release(c8_vm_t* vm) {
+	for (int i = 0; i < C8_PAGE_COUNT; i++) {
+		if (vm->c8_pages[i] != NULL) {
+			c8_page_release(vm->c8_pages[i]);
+			vm->c8_pages[i] = NULL;
+		}
+	}
+}
+
+/*
+ * Gives the instance a private copy of a shared page. Stops the instance
+ * if no memory is left for the copy.
+ */
+c8_page_t* c8_mem_unshare(c8_vm_t* vm, uint16_t index) {
+	c8_page_t* shared = vm->c8_pages[index];
+	c8_page_t* page = c8_page_alloc();
+
+	if (page == NULL) {
+		vm->c8_run = 0;
+		return NULL;
+	}
+
+	page->c8_refs = 1;
+	page->c8_hash = __atomic_load_n(&shared->c8_hash, __ATOMIC_RELAXED);
+	memcpy(page->c8_data, shared->c8_data, C8_PAGE_SIZE);
+	vm->c8_pages[index] = page;
+	c8_page_release(shared);
+
+	return page;
+}
+
+/*
+ * Word-at-a-time multiplicative hash. Not cryptographic; used to detect
+ * duplicate states, where speed matters more than anything else.
+ */
+uint64_t c8_mem_hash_bytes(const void* data, size_t len, uint64_t seed) {
+	const uint8_t* bytes = data;
+	uint64_t h = seed ^ (len * HASH_MULTIPLIER);
+	size_t i;
+
+	for (i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+		uint64_t w;
+		memcpy(&w, &bytes[i], sizeof(w));
+		h = (h ^ w) * HASH_MULTIPLIER;
+		h ^= h >> 29;
+	}
+
+	for (; i < len; i++) {
+		h = (h ^ bytes[i]) * HASH_MULTIPLIER;
+	}
+
+	h ^= h >> 32;
+
+	return h;
+}
+
+static uint64_t c8_mem_page_hash(c8_page_t* page) {
+	uint64_t h = __atomic_load_n(&page->c8_hash, __ATOMIC_RELAXED);
+
+	if (h == 0) {
+		h = c8_mem_hash_bytes(page->c8_data, C8_PAGE_SIZE, 0);
+		h += h == 0;
+		__atomic_store_n(&page->c8_hash, h, __ATOMIC_RELAXED);
+	}
+
+	return h;
+}
+
+/*
+ * Hash of the instance's memory. Shared pages are hashed once however
+ * many instances reference them.
+ */
+uint64_t c8_mem_hash(const c8_vm_t* vm) {
+	uint64_t h = 0;
+
+	for (int i = 0; i < C8_PAGE_COUNT; i++) {
+		h = (h ^ c8_mem_page_hash(vm->c8_pages[i])) * HASH_MULTIPLIER;
+		h ^= h >> 29;
+	}
+
+	return h;
+}
@@ -0,0 +1,409 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <SDL2/SDL.h>
+#include "metrics.h"
+
+#define METRICS_INTERVAL_MS 1000
+#define METRICS_SUB_BITS 4
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BITS)
+#define METRICS_BUCKETS ((32 - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS)
+#define METRICS_SOCKET_PREFIX "unix:"
+#define METRICS_SNAPSHOT_LENGTH 1024
+#define METRICS_LATE_FRAME_PERCENT 150
+
+#define OVERLAY_PIXEL 2
+#define OVERLAY_GLYPH_WIDTH 4
+#define OVERLAY_GLYPH_HEIGHT 5
+#define OVERLAY_DIGITS 8
+#define OVERLAY_LINES 4
+#define OVERLAY_MARGIN 4
+#define OVERLAY_LINE_HEIGHT ((OVERLAY_GLYPH_HEIGHT + 2) * OVERLAY_PIXEL)
+
+/*
+ * Log-linear histogram: small values have a bucket each, above that every
+ * power of two is split into METRICS_SUB_BUCKETS buckets, which keeps
+ * percentiles within a few percent.
+ */
+typedef struct {
+	uint32_t buckets[METRICS_BUCKETS];
+	uint64_t count;
+	uint64_t sum;
+	uint32_t max;
+} c8_histogram_t;
+
+typedef struct {
+	uint64_t mean;
+	uint32_t p50;
+	uint32_t p99;
+	uint32_t max;
+} c8_histogram_summary_t;
+
+static int c8_metrics_on;
+static int c8_metrics_json;
+static int c8_metrics_show_overlay;
+static int c8_metrics_instances;
+static char c8_metrics_dest[PATH_MAX];
+static int c8_metrics_socket = -1;
+static struct sockaddr_un c8_metrics_addr;
+
+static uint64_t c8_metrics_freq;
+static uint64_t c8_metrics_last_frame;
+static uint64_t c8_metrics_interval_start;
+static uint64_t c8_metrics_instructions;
+static uint64_t c8_metrics_cycles;
+static uint32_t c8_metrics_frames;
+static uint64_t c8_metrics_dropped_frames;
+static uint64_t c8_metrics_late_frames;
+static uint32_t c8_metrics_audio_queued_ms;
+static uint64_t c8_metrics_audio_underruns;
+static uint32_t c8_metrics_pending_input;
+static uint8_t c8_metrics_input_pending;
+
+static c8_histogram_t c8_frame_time;
+static c8_histogram_t c8_present_time;
+static c8_histogram_t c8_input_latency;
+
+static uint32_t c8_metrics_shown[OVERLAY_LINES];
+
+static int c8_histogram_bucket(uint32_t v) {
+	if (v < METRICS_SUB_BUCKETS) {
+		return v;
+	}
+
+	int msb = 31 - __builtin_clz(v);
+
+	return (msb - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS + ((v >> (msb - METRICS_SUB_BITS)) & (METRICS_SUB_BUCKETS - 1));
+}
+
+static uint32_t c8_histogram_bucket_mid(int bucket) {
+	if (bucket < METRICS_SUB_BUCKETS) {
+		return bucket;
+	}
+
+	int shift = bucket / METRICS_SUB_BUCKETS - 1;
+	uint64_t lower = (uint64_t) (METRICS_SUB_BUCKETS + (bucket % METRICS_SUB_BUCKETS)) << shift;
+
+	return lower + ((1ULL << shift) / 2);
+}
+
+static void c8_histogram_add(c8_histogram_t* h, uint32_t v) {
+	h->buckets[c8_histogram_bucket(v)]++;
+	h->count++;
+	h->sum += v;
+
+	if (v > h->max) {
+		h->max = v;
+	}
+}
+
+static uint32_t c8_histogram_percentile(c8_histogram_t* h, int percent) {
+	uint64_t rank = (h->count * percent + 99) / 100;
+	uint64_t seen = 0;
+
+	for (int i = 0; i < METRICS_BUCKETS; i++) {
+		seen += h->buckets[i];
+
+		if (seen >= rank && seen != 0) {
+			uint32_t mid = c8_histogram_bucket_mid(i);
+			return mid < h->max ? mid : h->max;
+		}
+	}
+
+	return h->max;
+}
+
+static c8_histogram_summary_t c8_histogram_summarize(c8_histogram_t* h) {
+	c8_histogram_summary_t s = { 0, 0, 0, 0 };
+
+	if (h->count != 0) {
+		s.mean = h->sum / h->count;
+		s.p50 = c8_histogram_percentile(h, 50);
+		s.p99 = c8_histogram_percentile(h, 99);
+		s.max = h->max;
+	}
+
+	memset(h, 0, sizeof(*h));
+
+	return s;
+}
+
+static uint32_t c8_metrics_us(uint64_t ticks) {
+	uint64_t us = (ticks * 1000000) / c8_metrics_freq;
+
+	return us > UINT32_MAX ? UINT32_MAX : us;
+}
+
+/*
+ * Sends the snapshot as one datagram to "unix:/path", or atomically
+ * replaces the file at dest with it.
+ */
+static void c8_metrics_export(const char* snapshot, int len) {
+	if (c8_metrics_socket != -1) {
+		sendto(c8_metrics_socket, snapshot, len, MSG_DONTWAIT, (struct sockaddr *) &c8_metrics_addr, sizeof(c8_metrics_addr));
+		return;
+	}
+
+	if (c8_metrics_dest[0] == '\0') {
+		return;
+	}
+
+	char tmp_path[PATH_MAX + 4];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", c8_metrics_dest);
+	FILE* f = fopen(tmp_path, "w");
+
+	if (f == NULL) {
+		return;
+	}
+
+	fwrite(snapshot, 1, len, f);
+
+	if (fclose(f) == 0) {
+		rename(tmp_path, c8_metrics_dest);
+	}
+}
+
+static int c8_metrics_format_histogram(char* buf, size_t len, const char* name, c8_histogram_summary_t* s) {
+	if (c8_metrics_json) {
+		return snprintf(buf, len, "\"%s\":{\"mean\":%llu,\"p50\":%u,\"p99\":%u,\"max\":%u},", name,
+				(unsigned long long) s->mean, s->p50, s->p99, s->max);
+	}
+
+	return snprintf(buf, len, "%s mean=%llu p50=%u p99=%u max=%u\n", name,
+			(unsigned long long) s->mean, s->p50, s->p99, s->max);
+}
+
+static void c8_metrics_snapshot(uint64_t now) {
+	char snapshot[METRICS_SNAPSHOT_LENGTH];
+	uint64_t elapsed_us = c8_metrics_us(now - c8_metrics_interval_start);
+	uint64_t ips = elapsed_us ? (c8_metrics_instructions * 1000000) / elapsed_us : 0;
+	uint64_t cps = elapsed_us ? (c8_metrics_cycles * 1000000) / elapsed_us : 0;
+	uint32_t audio_ms = c8_metrics_audio_queued_ms;
+	c8_histogram_summary_t frame = c8_histogram_summarize(&c8_frame_time);
+	c8_histogram_summary_t present = c8_histogram_summarize(&c8_present_time);
+	c8_histogram_summary_t latency = c8_histogram_summarize(&c8_input_latency);
+	int len;
+
+	if (c8_metrics_json) {
+		len = snprintf(snapshot, METRICS_SNAPSHOT_LENGTH, "{\"time_ms\":%u,\"ips\":%llu,\"cps\":%llu,\"target_cps\":%d,\"frames\":%u,"
+				"\"dropped_frames\":%llu,\"late_frames\":%llu,", SDL_GetTicks(), (unsigned long long) ips, (unsigned long long) cps,
+				C8_FRAME_CYCLES * FRAMES_PER_SECOND * c8_metrics_instances, c8_metrics_frames, (unsigned long long) c8_metrics_dropped_frames,
+				(unsigned long long) c8_metrics_late_frames);
+	} else {
+		len = snprintf(snapshot, METRICS_SNAPSHOT_LENGTH, "time_ms=%u\nips=%llu cps=%llu target_cps=%d\nframes=%u dropped=%llu late=%llu\n",
+				SDL_GetTicks(), (unsigned long long) ips, (unsigned long long) cps, C8_FRAME_CYCLES * FRAMES_PER_SECOND * c8_metrics_instances, c8_metrics_frames,
+				(unsigned long long) c8_metrics_dropped_frames, (unsigned long long) c8_metrics_late_frames);
+	}
+
+	len += c8_metrics_format_histogram(&snapshot[len], METRICS_SNAPSHOT_LENGTH - len, "frame_us", &frame);
+	len += c8_metrics_format_histogram(&snapshot[len], METRICS_SNAPSHOT_LENGTH - len, "present_us", &present);
+	len += c8_metrics_format_histogram(&snapshot[len], METRICS_SNAPSHOT_LENGTH - len, "input_latency_us", &latency);
+
+	if (c8_metrics_json) {
+		len += snprintf(&snapshot[len], METRICS_SNAPSHOT_LENGTH - len, "\"audio_queue_ms\":%u,\"audio_underruns\":%llu}\n",
+				audio_ms, (unsigned long long) c8_metrics_audio_underruns);
+	} else {
+		len += snprintf(&snapshot[len], METRICS_SNAPSHOT_LENGTH - len, "audio_queue_ms=%u audio_underruns=%llu\n\n",
+				audio_ms, (unsigned long long) c8_metrics_audio_underruns);
+	}
+
+	if (len > METRICS_SNAPSHOT_LENGTH - 1) {
+		len = METRICS_SNAPSHOT_LENGTH - 1;
+	}
+
+	c8_metrics_export(snapshot, len);
+
+	c8_metrics_shown[0] = ips;
+	c8_metrics_shown[1] = frame.p99;
+	c8_metrics_shown[2] = latency.p99 / 1000;
+	c8_metrics_shown[3] = audio_ms;
+
+	c8_metrics_instructions = 0;
+	c8_metrics_cycles = 0;
+	c8_metrics_frames = 0;
+	c8_metrics_interval_start = now;
+}
+
+/*
+ * dest is a file path, "unix:/path" for a datagram socket, or NULL to
+ * only feed the overlay. The target rate, in emulated machine cycles per
+ * second, scales with the number of instances stepped per host frame.
+ */
+int c8_metrics_init(const char* dest, int json, int overlay, int instances) {
+	c8_metrics_instances = instances;
+	c8_metrics_json = json;
+	c8_metrics_show_overlay = overlay;
+	c8_metrics_dest[0] = '\0';
+
+	if (dest != NULL && strncmp(dest, METRICS_SOCKET_PREFIX, strlen(METRICS_SOCKET_PREFIX)) == 0) {
+		const char* path = &dest[strlen(METRICS_SOCKET_PREFIX)];
+
+		if (strlen(path) >= sizeof(c8_metrics_addr.sun_path)) {
+			return ENAMETOOLONG;
+		}
+
+		if ((c8_metrics_socket = socket(AF_UNIX, SOCK_DGRAM, 0)) == -1) {
+			return errno;
+		}
+
+		memset(&c8_metrics_addr, 0, sizeof(c8_metrics_addr));
+		c8_metrics_addr.sun_family = AF_UNIX;
+		strcpy(c8_metrics_addr.sun_path, path);
+	} else if (dest != NULL && snprintf(c8_metrics_dest, PATH_MAX, "%s", dest) >= PATH_MAX) {
+		return ENAMETOOLONG;
+	}
+
+	c8_metrics_freq = SDL_GetPerformanceFrequency();
+	c8_metrics_last_frame = 0;
+	c8_metrics_interval_start = SDL_GetPerformanceCounter();
+	c8_metrics_on = 1;
+
+	return 0;
+}
+
+int c8_metrics_enabled() {
+	return c8_metrics_on;
+}
+
+/*
+ * Called once per host frame with the instructions and emulated cycles it
+ * ran and the frames the scheduler had to drop to catch up.
+ */
+void c8_metrics_frame(uint32_t instructions, uint32_t cycles, int dropped) {
+	if (!c8_metrics_on) {
+		return;
+	}
+
+	uint64_t now = SDL_GetPerformanceCounter();
+
+	if (c8_metrics_last_frame != 0) {
+		uint32_t frame_us = c8_metrics_us(now - c8_metrics_last_frame);
+		c8_histogram_add(&c8_frame_time, frame_us);
+
+		if (frame_us > (1000000 / FRAMES_PER_SECOND) * METRICS_LATE_FRAME_PERCENT / 100) {
+			c8_metrics_late_frames++;
+		}
+	}
+
+	c8_metrics_last_frame = now;
+	c8_metrics_instructions += instructions;
+	c8_metrics_cycles += cycles;
+	c8_metrics_dropped_frames += dropped;
+	c8_metrics_frames++;
+
+	if (c8_metrics_us(now - c8_metrics_interval_start) >= METRICS_INTERVAL_MS * 1000) {
+		c8_metrics_snapshot(now);
+	}
+}
+
+void c8_metrics_present(uint64_t begin, uint64_t end) {
+	if (!c8_metrics_on) {
+		return;
+	}
+
+	c8_histogram_add(&c8_present_time, c8_metrics_us(end - begin));
+
+	if (c8_metrics_input_pending) {
+		c8_histogram_add(&c8_input_latency, (SDL_GetTicks() - c8_metrics_pending_input) * 1000);
+		c8_metrics_input_pending = 0;
+	}
+}
+
+/*
+ * Input latency runs from the key event's timestamp to the end of the
+ * next present.
+ */
+void c8_metrics_input(uint32_t timestamp) {
+	if (c8_metrics_on && !c8_metrics_input_pending) {
+		c8_metrics_pending_input = timestamp;
+		c8_metrics_input_pending = 1;
+	}
+}
+
+void c8_metrics_audio(uint32_t queued_ms, int underrun) {
+	c8_metrics_audio_queued_ms = queued_ms;
+	c8_metrics_audio_underruns += underrun;
+}
+
+void c8_metrics_toggle_overlay() {
+	c8_metrics_show_overlay = !c8_metrics_show_overlay;
+}
+
+static void c8_metrics_draw_number(struct SDL_Renderer* renderer, int x, int y, uint32_t value) {
+	char digits[OVERLAY_DIGITS + 1];
+	int n = snprintf(digits, sizeof(digits), "%u", value);
+
+	for (int d = 0; d < n && d < OVERLAY_DIGITS; d++) {
+		const uint8_t* glyph = &c8_font[(digits[d] - '0') * OVERLAY_GLYPH_HEIGHT];
+
+		for (int row = 0; row < OVERLAY_GLYPH_HEIGHT; row++) {
+			for (int col = 0; col < OVERLAY_GLYPH_WIDTH; col++) {
+				if (glyph[row] & (0x80 >> col)) {
+					SDL_Rect pix = {
+							x + (d * (OVERLAY_GLYPH_WIDTH + 1) + col) * OVERLAY_PIXEL,
+							y + row * OVERLAY_PIXEL,
+							OVERLAY_PIXEL,
+							OVERLAY_PIXEL
+					};
+					SDL_RenderFillRect(renderer, &pix);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Draws the last snapshot with the CHIP-8 font, one line each for
+ * instructions per second, p99 frame time (us), p99 input latency (ms)
+ * and queued audio (ms). The swatch in front tells the lines apart.
+ */
+void c8_metrics_overlay(struct SDL_Renderer* renderer) {
+	static const uint32_t swatches[OVERLAY_LINES] = { 0x4caf50, 0x2196f3, 0xff9800, 0xe91e63 };
+
+	if (!c8_metrics_on || !c8_metrics_show_overlay) {
+		return;
+	}
+
+	int swatch = OVERLAY_GLYPH_HEIGHT * OVERLAY_PIXEL;
+	SDL_Rect background = {
+			0,
+			0,
+			OVERLAY_MARGIN * 3 + swatch + OVERLAY_DIGITS * (OVERLAY_GLYPH_WIDTH + 1) * OVERLAY_PIXEL,
+			OVERLAY_MARGIN * 2 + OVERLAY_LINES * OVERLAY_LINE_HEIGHT
+	};
+
+	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xa0);
+	SDL_RenderFillRect(renderer, &background);
+
+	for (int i = 0; i < OVERLAY_LINES; i++) {
+		int y = OVERLAY_MARGIN + i * OVERLAY_LINE_HEIGHT;
+		SDL_Rect legend = { OVERLAY_MARGIN, y, swatch, swatch };
+
+		SDL_SetRenderDrawColor(renderer, swatches[i] >> 16, (swatches[i] >> 8) & 0xff, swatches[i] & 0xff, 0xff);
+		SDL_RenderFillRect(renderer, &legend);
+		SDL_SetRenderDrawColor(renderer, 0xff, 0xff, 0xff, 0xff);
+		c8_metrics_draw_number(renderer, OVERLAY_MARGIN * 2 + swatch, y, c8_metrics_shown[i]);
+	}
+}
+
+void c8_metrics_destroy() {
+	if (c8_metrics_socket != -1) {
+		close(c8_metrics_socket);
+		c8_metrics_socket = -1;
+	}
+
+	c8_metrics_on = 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#include <errno.h>
+#include <SDL2/SDL.h>
+#include "monitor.h"
+#include "display.h"
+#include "metrics.h"
+
+#define MONITOR_TILE_GAP 1
+#define MONITOR_TILE_WIDTH (SCREEN_WIDTH + MONITOR_TILE_GAP)
+#define MONITOR_TILE_HEIGHT (SCREEN_HEIGHT + MONITOR_TILE_GAP)
+#define MONITOR_MAX_WIDTH 1280
+#define MONITOR_MAX_SCALING 10
+#define MONITOR_COLOR_GAP 0x101010
+
+static SDL_Window* c8_monitor_window;
+static SDL_Renderer *c8_monitor_renderer;
+static SDL_Texture *c8_monitor_atlas;
+static int c8_monitor_cols;
+
+/*
+ * All instances share one streaming texture laid out as a grid of tiles,
+ * so a host frame costs one copy and one present however many VMs run.
+ * Returns E2BIG if the grid doesn't fit the renderer's largest texture.
+ */
+int c8_monitor_init(int count) {
+	SDL_RendererInfo info;
+	int cols = 1;
+
+	while (cols * cols < count) {
+		cols++;
+	}
+
+	c8_monitor_renderer = NULL;
+	c8_monitor_atlas = NULL;
+	c8_monitor_window = SDL_CreateWindow("Chipollotto", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 1, 1, SDL_WINDOW_HIDDEN);
+
+	if (c8_monitor_window == NULL || (c8_monitor_renderer = SDL_CreateRenderer(c8_monitor_window, -1, 0)) == NULL) {
+		return -1;
+	}
+
+	/* a square grid too wide for the texture becomes a taller one */
+	if (SDL_GetRendererInfo(c8_monitor_renderer, &info) == 0 && info.max_texture_width != 0) {
+		int max_cols = info.max_texture_width / MONITOR_TILE_WIDTH;
+		int max_rows = info.max_texture_height / MONITOR_TILE_HEIGHT;
+
+		if (cols > max_cols) {
+			cols = max_cols;
+		}
+
+		if (cols < 1 || (count + cols - 1) / cols > max_rows) {
+			return E2BIG;
+		}
+	}
+
+	int rows = (count + cols - 1) / cols;
+	int width = cols * MONITOR_TILE_WIDTH;
+	int height = rows * MONITOR_TILE_HEIGHT;
+	int scaling = MONITOR_MAX_WIDTH / width;
+
+	if (scaling < 1) {
+		scaling = 1;
+	} else if (scaling > MONITOR_MAX_SCALING) {
+		scaling = MONITOR_MAX_SCALING;
+	}
+
+	c8_monitor_cols = cols;
+	SDL_SetWindowSize(c8_monitor_window, width * scaling, height * scaling);
+	SDL_ShowWindow(c8_monitor_window);
+	SDL_RenderSetLogicalSize(c8_monitor_renderer, width * scaling, height * scaling);
+	c8_monitor_atlas = SDL_CreateTexture(c8_monitor_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+
+	if (c8_monitor_atlas == NULL) {
+		return -1;
+	}
+
+	uint32_t* pixels;
+	int pitch;
+
+	SDL_LockTexture(c8_monitor_atlas, NULL, (void *) &pixels, &pitch);
+	pitch /= sizeof(uint32_t);
+
+	for (int i = 0; i < height; i++) {
+		for (int j = 0; j < width; j++) {
+			pixels[(i * pitch) + j] = MONITOR_COLOR_GAP;
+		}
+	}
+
+	SDL_UnlockTexture(c8_monitor_atlas);
+
+	return 0;
+}
+
+int c8_monitor_draw(c8_vm_t* vms, int count) {
+	uint64_t begin = SDL_GetPerformanceCounter();
+
+	for (int i = 0; i < count; i++) {
+		if (!vms[i].c8_draw) {
+			continue;
+		}
+
+		SDL_Rect tile = {
+				(i % c8_monitor_cols) * MONITOR_TILE_WIDTH,
+				(i / c8_monitor_cols) * MONITOR_TILE_HEIGHT,
+				SCREEN_WIDTH,
+				SCREEN_HEIGHT
+		};
+		uint32_t* pixels;
+		int pitch;
+
+		SDL_LockTexture(c8_monitor_atlas, &tile, (void *) &pixels, &pitch);
+		c8_display_convert(&vms[i], pixels, pitch / sizeof(uint32_t));
+		SDL_UnlockTexture(c8_monitor_atlas);
+
+		vms[i].c8_draw = 0;
+	}
+
+	SDL_RenderClear(c8_monitor_renderer);
+	SDL_RenderCopy(c8_monitor_renderer, c8_monitor_atlas, NULL, NULL);
+	c8_metrics_overlay(c8_monitor_renderer);
+	SDL_RenderPresent(c8_monitor_renderer);
+	c8_metrics_present(begin, SDL_GetPerformanceCounter());
+
+	return 0;
+}
+
+void c8_monitor_destroy() {
+	SDL_DestroyTexture(c8_monitor_atlas);
+	SDL_DestroyRenderer(c8_monitor_renderer);
+	SDL_DestroyWindow(c8_monitor_window);
+}
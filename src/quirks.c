@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "quirks.h"
+
+#define QUIRKS_PROFILE_EXT ".quirks"
+#define QUIRKS_PROFILE_MAX 256
+#define QUIRKS_SEPARATORS " \t\r\n,"
+
+typedef struct {
+	const char* name;
+	uint8_t quirk;
+} c8_quirk_name_t;
+
+static const c8_quirk_name_t c8_quirk_names[C8_QUIRK_COUNT] = {
+		{ "shift", C8_QUIRK_SHIFT },
+		{ "load", C8_QUIRK_LOAD },
+		{ "clip", C8_QUIRK_CLIP },
+		{ "vfreset", C8_QUIRK_VF_RESET },
+		{ "jump", C8_QUIRK_JUMP },
+		{ "vblank", C8_QUIRK_VBLANK }
+};
+
+static int c8_quirks_lookup(const char* name) {
+	for (int i = 0; i < C8_QUIRK_COUNT; i++) {
+		if (strcmp(name, c8_quirk_names[i].name) == 0) {
+			return c8_quirk_names[i].quirk;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Parses a comma or whitespace separated list of quirk names, e.g.
+ * "shift,load". Everything after a '#' is a comment.
+ */
+int c8_quirks_parse(const char* names, uint8_t* quirks) {
+	char buf[QUIRKS_PROFILE_MAX];
+	uint8_t result = 0;
+
+	strncpy(buf, names, QUIRKS_PROFILE_MAX - 1);
+	buf[QUIRKS_PROFILE_MAX - 1] = '\0';
+
+	char* comment = strchr(buf, '#');
+
+	if (comment != NULL) {
+		*comment = '\0';
+	}
+
+	char* saveptr;
+
+	for (char* tok = strtok_r(buf, QUIRKS_SEPARATORS, &saveptr); tok != NULL; tok = strtok_r(NULL, QUIRKS_SEPARATORS, &saveptr)) {
+		int quirk = c8_quirks_lookup(tok);
+
+		if (quirk == -1) {
+			return EINVAL;
+		}
+
+		result |= quirk;
+	}
+
+	*quirks = result;
+
+	return 0;
+}
+
+/*
+ * Reads the per-ROM quirk profile stored next to the ROM as
+ * "<rom_path>.quirks". Returns ENOENT if the ROM has no profile.
+ */
+int c8_quirks_load_profile(const char* rom_path, uint8_t* quirks) {
+	char path[QUIRKS_PROFILE_MAX];
+	char line[QUIRKS_PROFILE_MAX];
+	uint8_t result = 0;
+
+	if (snprintf(path, QUIRKS_PROFILE_MAX, "%s%s", rom_path, QUIRKS_PROFILE_EXT) >= QUIRKS_PROFILE_MAX) {
+		return ENAMETOOLONG;
+	}
+
+	FILE* f = fopen(path, "r");
+
+	if (f == NULL) {
+		return errno;
+	}
+
+	while (fgets(line, QUIRKS_PROFILE_MAX, f) != NULL) {
+		uint8_t line_quirks;
+
+		if (c8_quirks_parse(line, &line_quirks) != 0) {
+			fclose(f);
+			return EINVAL;
+		}
+
+		result |= line_quirks;
+	}
+
+	fclose(f);
+	*quirks = result;
+
+	return 0;
+}
+
+const char* c8_quirks_name(uint8_t quirk) {
+	for (int i = 0; i < C8_QUIRK_COUNT; i++) {
+		if (c8_quirk_names[i].quirk == quirk) {
+			return c8_quirk_names[i].name;
+		}
+	}
+
+	return NULL;
+}
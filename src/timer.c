@@ -9,28 +9,44 @@
 #include <SDL2/SDL.h>
 #include "timer.h"
 
-#define TIMER_INTERVAL_NS 16
-
-long last_update;
+static uint64_t next_frame;
 
 
 void c8_timer_init() {
-	last_update = SDL_GetTicks();
+	next_frame = SDL_GetPerformanceCounter();
 }
 
-int c8_timer_update(c8_vm_t* vm) {
-	uint32_t sys_time = SDL_GetTicks();
+int c8_timer_tick(c8_vm_t* vm) {
+	if (vm->c8_delay_timer > 0) {
+		vm->c8_delay_timer--;
+	}
 
-	if ((sys_time - last_update) >= TIMER_INTERVAL_NS) {
-		if (vm->c8_delay_timer > 0) {
-			vm->c8_delay_timer--;
-		}
+	if (vm->c8_sound_timer > 0) {
+		vm->c8_sound_timer--;
+	}
 
-		if (vm->c8_sound_timer > 0) {
-			vm->c8_sound_timer--;
-		}
+	return 0;
+}
 
-		last_update = sys_time;
+/*
+ * Sleeps until the next 60 Hz frame is due. If the host fell more than a
+ * frame behind, the schedule is reset instead of running frames back to
+ * back to catch up; the return value is the number of frames dropped.
+ */
+int c8_timer_wait_frame() {
+	uint64_t freq = SDL_GetPerformanceFrequency();
+	uint64_t frame = freq / FRAMES_PER_SECOND;
+	uint64_t now = SDL_GetPerformanceCounter();
+
+	next_frame += frame;
+
+	if (now < next_frame) {
+		SDL_Delay(((next_frame - now) * 1000) / freq);
+	} else if ((now - next_frame) > frame) {
+		int dropped = (now - next_frame) / frame;
+		next_frame = now;
+		return dropped;
 	}
+
 	return 0;
 }
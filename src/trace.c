@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include "trace.h"
+#include "mem.h"
+
+#define TRACE_CHUNK_RECORDS 16384
+#define TRACE_MAX_THREADS 64
+
+_Static_assert(sizeof(c8_trace_record_t) == 48, "trace records are fixed size");
+
+typedef struct c8_trace_buffer c8_trace_buffer_t;
+
+typedef struct c8_trace_chunk {
+	struct c8_trace_chunk* next;
+	c8_trace_buffer_t* owner;
+	uint32_t count;
+	c8_trace_record_t records[TRACE_CHUNK_RECORDS];
+} c8_trace_chunk_t;
+
+/*
+ * Per-thread state. In streaming mode full chunks are handed to the
+ * flusher thread; in ring mode only the last ring_size records are kept
+ * and written out on close.
+ */
+struct c8_trace_buffer {
+	FILE* file;
+	c8_trace_chunk_t* chunk;
+	c8_trace_record_t* ring;
+	uint32_t ring_size;
+	uint32_t ring_head;
+	uint8_t ring_wrapped;
+	uint32_t index;
+	c8_trace_record_t pending;
+	uint8_t registers[REGISTERS_COUNT];
+};
+
+static char c8_trace_path[PATH_MAX];
+static uint32_t c8_trace_ring_records;
+static int c8_trace_on;
+static int c8_trace_stop;
+static int c8_trace_error;
+static pthread_t c8_trace_flusher;
+static pthread_mutex_t c8_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t c8_trace_ready = PTHREAD_COND_INITIALIZER;
+static c8_trace_chunk_t* c8_trace_queue_head;
+static c8_trace_chunk_t* c8_trace_queue_tail;
+static c8_trace_chunk_t* c8_trace_free_chunks;
+static c8_trace_buffer_t* c8_trace_buffers[TRACE_MAX_THREADS];
+static int c8_trace_buffer_count;
+
+static _Thread_local c8_trace_buffer_t* c8_trace_local;
+
+static void* c8_trace_flush_main(void* arg) {
+	(void) arg;
+
+	pthread_mutex_lock(&c8_trace_lock);
+
+	for (;;) {
+		while (c8_trace_queue_head == NULL && !c8_trace_stop) {
+			pthread_cond_wait(&c8_trace_ready, &c8_trace_lock);
+		}
+
+		c8_trace_chunk_t* chunk = c8_trace_queue_head;
+
+		if (chunk == NULL) {
+			break;
+		}
+
+		c8_trace_queue_head = chunk->next;
+
+		if (c8_trace_queue_head == NULL) {
+			c8_trace_queue_tail = NULL;
+		}
+
+		pthread_mutex_unlock(&c8_trace_lock);
+
+		size_t written = fwrite(chunk->records, sizeof(c8_trace_record_t), chunk->count, chunk->owner->file);
+
+		pthread_mutex_lock(&c8_trace_lock);
+
+		if (written != chunk->count) {
+			c8_trace_error = EIO;
+		}
+
+		chunk->next = c8_trace_free_chunks;
+		c8_trace_free_chunks = chunk;
+	}
+
+	pthread_mutex_unlock(&c8_trace_lock);
+
+	return NULL;
+}
+
+/*
+ * Caller holds c8_trace_lock.
+ */
+static c8_trace_chunk_t* c8_trace_chunk_alloc(c8_trace_buffer_t* owner) {
+	c8_trace_chunk_t* chunk = c8_trace_free_chunks;
+
+	if (chunk != NULL) {
+		c8_trace_free_chunks = chunk->next;
+	} else if ((chunk = malloc(sizeof(c8_trace_chunk_t))) == NULL) {
+		return NULL;
+	}
+
+	chunk->next = NULL;
+	chunk->owner = owner;
+	chunk->count = 0;
+
+	return chunk;
+}
+
+/*
+ * Caller holds c8_trace_lock.
+ */
+static void c8_trace_enqueue(c8_trace_chunk_t* chunk) {
+	if (c8_trace_queue_tail != NULL) {
+		c8_trace_queue_tail->next = chunk;
+	} else {
+		c8_trace_queue_head = chunk;
+	}
+
+	c8_trace_queue_tail = chunk;
+	pthread_cond_signal(&c8_trace_ready);
+}
+
+/*
+ * Every thread that executes traced instructions writes its own file:
+ * the first one the given path, the following ones path.1, path.2, ...
+ */
+static c8_trace_buffer_t* c8_trace_buffer_create() {
+	char path[PATH_MAX + 16];
+	c8_trace_header_t header;
+	c8_trace_buffer_t* buf = calloc(1, sizeof(c8_trace_buffer_t));
+
+	if (buf == NULL) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&c8_trace_lock);
+
+	if (c8_trace_buffer_count == TRACE_MAX_THREADS) {
+		goto fail;
+	}
+
+	if (c8_trace_buffer_count == 0) {
+		snprintf(path, sizeof(path), "%s", c8_trace_path);
+	} else {
+		snprintf(path, sizeof(path), "%s.%d", c8_trace_path, c8_trace_buffer_count);
+	}
+
+	if ((buf->file = fopen(path, "wb")) == NULL) {
+		goto fail;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, C8_TRACE_MAGIC, sizeof(C8_TRACE_MAGIC));
+	header.version = C8_TRACE_VERSION;
+	header.record_size = sizeof(c8_trace_record_t);
+	fwrite(&header, sizeof(header), 1, buf->file);
+
+	if (c8_trace_ring_records != 0) {
+		buf->ring_size = c8_trace_ring_records;
+		buf->ring = malloc(buf->ring_size * sizeof(c8_trace_record_t));
+
+		if (buf->ring == NULL) {
+			goto fail;
+		}
+	} else if ((buf->chunk = c8_trace_chunk_alloc(buf)) == NULL) {
+		goto fail;
+	}
+
+	c8_trace_buffers[c8_trace_buffer_count++] = buf;
+	pthread_mutex_unlock(&c8_trace_lock);
+
+	return buf;
+
+fail:
+	c8_trace_error = errno ? errno : ENOMEM;
+	pthread_mutex_unlock(&c8_trace_lock);
+
+	if (buf->file != NULL) {
+		fclose(buf->file);
+	}
+
+	free(buf);
+
+	return NULL;
+}
+
+/*
+ * Starts tracing to path. With ring_records != 0 only the most recent
+ * ring_records instructions of each thread are kept.
+ */
+int c8_trace_open(const char* path, uint32_t ring_records) {
+	if (snprintf(c8_trace_path, PATH_MAX, "%s", path) >= PATH_MAX) {
+		return ENAMETOOLONG;
+	}
+
+	c8_trace_ring_records = ring_records;
+	c8_trace_stop = 0;
+	c8_trace_error = 0;
+
+	if (ring_records == 0) {
+		int err = pthread_create(&c8_trace_flusher, NULL, c8_trace_flush_main, NULL);
+
+		if (err != 0) {
+			return err;
+		}
+	}
+
+	c8_trace_on = 1;
+
+	/*
+	 * The calling thread runs the VMs, so its file is created here and a
+	 * bad path fails right away instead of on the first instruction.
+	 */
+	if ((c8_trace_local = c8_trace_buffer_create()) == NULL) {
+		return c8_trace_close();
+	}
+
+	return 0;
+}
+
+int c8_trace_active() {
+	return c8_trace_on;
+}
+
+void c8_trace_begin(c8_vm_t* vm) {
+	c8_trace_buffer_t* buf = c8_trace_local;
+
+	if (buf == NULL) {
+		/* a thread whose file could not be created does not retry */
+		if (__atomic_load_n(&c8_trace_error, __ATOMIC_RELAXED) != 0 || (buf = c8_trace_local = c8_trace_buffer_create()) == NULL) {
+			return;
+		}
+	}
+
+	uint16_t pc = vm->c8_program_counter & (MEMORY_SIZE - 1);
+
+	buf->pending.pc = pc;
+	buf->pending.opcode = c8_mem_read(vm, pc) << 8 | c8_mem_read(vm, pc + 1);
+	buf->pending.mem_len = 0;
+	buf->pending.mem_addr = 0;
+	memcpy(buf->registers, vm->c8_registers, REGISTERS_COUNT);
+}
+
+void c8_trace_write(uint16_t addr, uint8_t val) {
+	c8_trace_buffer_t* buf = c8_trace_local;
+
+	if (buf == NULL) {
+		return;
+	}
+
+	if (buf->pending.mem_len == 0) {
+		buf->pending.mem_addr = addr;
+	}
+
+	if (buf->pending.mem_len < C8_TRACE_MAX_WRITES) {
+		buf->pending.mem[buf->pending.mem_len++] = val;
+	}
+}
+
+void c8_trace_end(c8_vm_t* vm) {
+	c8_trace_buffer_t* buf = c8_trace_local;
+
+	if (buf == NULL) {
+		return;
+	}
+
+	c8_trace_record_t* rec = &buf->pending;
+	rec->index = buf->index++;
+	rec->immediate = vm->c8_immediate;
+	rec->stack_counter = vm->c8_stack_counter;
+	rec->reg_mask = 0;
+
+	for (int i = 0; i < REGISTERS_COUNT; i++) {
+		if (vm->c8_registers[i] != buf->registers[i]) {
+			rec->reg_mask |= 1 << i;
+		}
+	}
+
+	memcpy(rec->registers, vm->c8_registers, REGISTERS_COUNT);
+	memset(&rec->mem[rec->mem_len], 0, C8_TRACE_MAX_WRITES - rec->mem_len);
+
+	if (buf->ring != NULL) {
+		buf->ring[buf->ring_head++] = *rec;
+
+		if (buf->ring_head == buf->ring_size) {
+			buf->ring_head = 0;
+			buf->ring_wrapped = 1;
+		}
+
+		return;
+	}
+
+	if (buf->chunk == NULL) {
+		return;
+	}
+
+	buf->chunk->records[buf->chunk->count++] = *rec;
+
+	if (buf->chunk->count == TRACE_CHUNK_RECORDS) {
+		pthread_mutex_lock(&c8_trace_lock);
+		c8_trace_enqueue(buf->chunk);
+		buf->chunk = c8_trace_chunk_alloc(buf);
+
+		if (buf->chunk == NULL) {
+			c8_trace_error = ENOMEM;
+		}
+
+		pthread_mutex_unlock(&c8_trace_lock);
+	}
+}
+
+static void c8_trace_write_ring(c8_trace_buffer_t* buf) {
+	size_t written = 0;
+	size_t expected = buf->ring_head;
+
+	if (buf->ring_wrapped) {
+		written += fwrite(&buf->ring[buf->ring_head], sizeof(c8_trace_record_t), buf->ring_size - buf->ring_head, buf->file);
+		expected += buf->ring_size - buf->ring_head;
+	}
+
+	written += fwrite(buf->ring, sizeof(c8_trace_record_t), buf->ring_head, buf->file);
+
+	if (written != expected) {
+		c8_trace_error = EIO;
+	}
+}
+
+/*
+ * Flushes and closes every thread's trace. Must only be called once the
+ * traced threads are done executing.
+ */
+int c8_trace_close() {
+	if (!c8_trace_on) {
+		return 0;
+	}
+
+	c8_trace_on = 0;
+
+	pthread_mutex_lock(&c8_trace_lock);
+
+	for (int i = 0; i < c8_trace_buffer_count; i++) {
+		if (c8_trace_buffers[i]->chunk != NULL) {
+			c8_trace_enqueue(c8_trace_buffers[i]->chunk);
+			c8_trace_buffers[i]->chunk = NULL;
+		}
+	}
+
+	c8_trace_stop = 1;
+	pthread_cond_signal(&c8_trace_ready);
+	pthread_mutex_unlock(&c8_trace_lock);
+
+	if (c8_trace_ring_records == 0) {
+		pthread_join(c8_trace_flusher, NULL);
+	}
+
+	for (int i = 0; i < c8_trace_buffer_count; i++) {
+		c8_trace_buffer_t* buf = c8_trace_buffers[i];
+
+		if (buf->ring != NULL) {
+			c8_trace_write_ring(buf);
+			free(buf->ring);
+		}
+
+		if (fclose(buf->file) != 0) {
+			c8_trace_error = EIO;
+		}
+
+		free(buf);
+	}
+
+	while (c8_trace_free_chunks != NULL) {
+		c8_trace_chunk_t* next = c8_trace_free_chunks->next;
+		free(c8_trace_free_chunks);
+		c8_trace_free_chunks = next;
+	}
+
+	c8_trace_buffer_count = 0;
+	c8_trace_local = NULL;
+
+	return c8_trace_error;
+}
@@ -13,44 +13,64 @@
 #include "display.h"
 #include "audio.h"
 #include "keypad.h"
+#include "monitor.h"
+#include "metrics.h"
+#include "mem.h"
 
-#define FONT_ARR_LENGTH 80
-
-const uint8_t c8_font[FONT_ARR_LENGTH] = {
-		0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-		0x20, 0x60, 0x20, 0x20, 0x70, // 1
-		0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-		0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-		0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-		0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-		0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-		0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-		0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-		0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-		0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-		0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-		0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-		0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-		0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-		0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-};
+void c8_vm_init(c8_vm_t* vm, const c8_image_t* image, uint32_t seed) {
+	c8_mem_attach(vm, image);
+	c8_cpu_select(vm);
 
+	vm->c8_rng = seed ? seed : 1;
+	vm->c8_cycle_budget = 0;
+	vm->c8_run = 1;
+	vm->c8_draw = 1;
+}
+
+void c8_vm_destroy(c8_vm_t* vm) {
+	c8_mem_release(vm);
+}
+
+/*
+ * Runs instructions until the frame's C8_FRAME_CYCLES are spent and ticks
+ * the timers once. Overshoot is carried into the next frame. Returns the
+ * number of instructions executed; if cycles isn't NULL it is set to the
+ * emulated cycles the frame used, stalls included.
+ */
+int c8_vm_frame(c8_vm_t* vm, uint32_t* cycles) {
+	int32_t start = vm->c8_cycle_budget + C8_FRAME_CYCLES;
+	int i;
+
+	vm->c8_cycle_budget = start;
+
+	for (i = 0; vm->c8_cycle_budget > 0 && vm->c8_run; i++) {
+		/* the instruction may zero the budget on a stall, so call it first */
+		int cost = vm->c8_cycle(vm);
+		vm->c8_cycle_budget -= cost;
+	}
+
+	c8_timer_tick(vm);
+
+	if (cycles != NULL) {
+		*cycles = start - vm->c8_cycle_budget;
+	}
+
+	return i;
+}
 
 int c8_vm_run(c8_vm_t* vm) {
-	memcpy(&vm->c8_memory[FONT_ADDR], c8_font, FONT_ARR_LENGTH);
 	c8_timer_init();
 	c8_display_init();
 	c8_audio_init();
 
-	vm->c8_run = 1;
-	vm->c8_draw = 1;
-
 	while (vm->c8_run) {
-		c8_cpu_cycle(vm);
-		c8_timer_update(vm);
+		uint32_t cycles;
+
 		c8_keypad_scan(vm);
+		int executed = c8_vm_frame(vm, &cycles);
 		c8_display_draw(vm);
 		c8_audio_play(vm);
+		c8_metrics_frame(executed, cycles, c8_timer_wait_frame());
 	}
 
 	c8_display_destroy();
@@ -58,3 +78,40 @@ int c8_vm_run(c8_vm_t* vm) {
 
 	return 0;
 }
+
+/*
+ * Runs all instances side by side in one window. Input goes to every
+ * instance; closing the window stops all of them.
+ */
+int c8_vm_run_monitor(c8_vm_t* vms, int count) {
+	c8_timer_init();
+
+	int err = c8_monitor_init(count);
+
+	if (err != 0) {
+		c8_monitor_destroy();
+		return err;
+	}
+
+	while (vms[0].c8_run) {
+		int executed = 0;
+		uint32_t cycles = 0;
+
+		c8_keypad_scan(&vms[0]);
+
+		for (int i = 0; i < count; i++) {
+			uint32_t spent;
+
+			vms[i].c8_keypad = vms[0].c8_keypad;
+			executed += c8_vm_frame(&vms[i], &spent);
+			cycles += spent;
+		}
+
+		c8_monitor_draw(vms, count);
+		c8_metrics_frame(executed, cycles, c8_timer_wait_frame());
+	}
+
+	c8_monitor_destroy();
+
+	return 0;
+}
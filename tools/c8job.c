@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+/*
+ * Sends a ROM job to chipollotto -D and prints the resulting state.
+ *
+ * cc -Iinclude tools/c8job.c src/quirks.c -o c8job
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "daemon.h"
+#include "quirks.h"
+
+#define C8JOB_FRAMES 60
+
+static void usage() {
+	puts("Usage: c8job [-f frames] [-k mask,...] [-q quirk,...] [-S seed] [-r repeat] socket rom");
+	puts("  -f  frames to run");
+	puts("  -k  hex keypad mask for each frame, the last one is held");
+	puts("  -r  send the job repeat times on one connection and report the latency");
+}
+
+static int c8job_connect(const char* path) {
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path) || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int c8job_read(int fd, void* buf, size_t len) {
+	uint8_t* p = buf;
+
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+
+		if (n <= 0) {
+			return -1;
+		}
+
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int c8job_parse_inputs(char* arg, uint16_t* inputs, uint32_t* count) {
+	for (char* tok = strtok(arg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+		char* end;
+		unsigned long mask = strtoul(tok, &end, 16);
+
+		if (*end != '\0' || mask > UINT16_MAX || *count == C8_JOB_MAX_INPUTS) {
+			return EINVAL;
+		}
+
+		inputs[(*count)++] = mask;
+	}
+
+	return 0;
+}
+
+static void c8job_print(const c8_job_result_t* result) {
+	printf("frames %" PRIu32 "%s PC %03x I %03x SP %x DT %02x ST %02x\n", result->frames, result->run ? "" : " (halted)",
+			result->program_counter, result->immediate, result->stack_counter, result->delay_timer, result->sound_timer);
+
+	for (int i = 0; i < REGISTERS_COUNT; i++) {
+		printf("V%X %02x%c", i, result->registers[i], i % 8 == 7 ? '\n' : ' ');
+	}
+
+	for (int y = 0; y < SCREEN_HEIGHT; y++) {
+		for (int x = 0; x < SCREEN_WIDTH; x++) {
+			putchar(result->frame_buffer[y][x / 8] & (0x80 >> (x % 8)) ? '#' : '.');
+		}
+
+		putchar('\n');
+	}
+}
+
+static uint64_t c8job_now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char* argv[]) {
+	static uint16_t inputs[C8_JOB_MAX_INPUTS];
+	uint8_t rom[MEMORY_SIZE - PROGRAMM_LOAD_ADDR];
+	c8_job_t job;
+	c8_job_result_t result;
+	uint32_t input_count = 0;
+	int repeat = 1;
+	int opt;
+
+	memset(&job, 0, sizeof(job));
+	job.magic = C8_JOB_MAGIC;
+	job.frames = C8JOB_FRAMES;
+	job.seed = time(NULL);
+
+	while ((opt = getopt(argc, argv, "f:k:q:r:S:")) != -1) {
+		switch (opt) {
+			case 'f':
+				job.frames = strtoul(optarg, NULL, 0);
+				break;
+			case 'k':
+				if (c8job_parse_inputs(optarg, inputs, &input_count) != 0) {
+					puts("Bad keypad mask");
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'q':
+				if (c8_quirks_parse(optarg, &job.quirks) != 0) {
+					puts("Unknown quirk");
+					return EXIT_FAILURE;
+				}
+
+				job.flags |= C8_JOB_QUIRKS;
+				break;
+			case 'r':
+				repeat = atoi(optarg);
+				break;
+			case 'S':
+				job.seed = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				usage();
+				return EXIT_FAILURE;
+		}
+	}
+
+	job.input_count = input_count;
+
+	if (argc - optind != 2 || repeat < 1) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	FILE* f = fopen(argv[optind + 1], "rb");
+
+	if (f == NULL) {
+		puts("Error reading file");
+		return EXIT_FAILURE;
+	}
+
+	job.rom_size = fread(rom, 1, sizeof(rom), f);
+	fclose(f);
+
+	int fd = c8job_connect(argv[optind]);
+
+	if (fd < 0) {
+		puts("Error connecting to daemon");
+		return EXIT_FAILURE;
+	}
+
+	uint64_t begin = c8job_now();
+
+	for (int i = 0; i < repeat; i++) {
+		if (write(fd, &job, sizeof(job)) != sizeof(job)
+				|| (i == 0 && write(fd, rom, job.rom_size) != job.rom_size)
+				|| write(fd, inputs, job.input_count * sizeof(uint16_t)) != (ssize_t) (job.input_count * sizeof(uint16_t))
+				|| c8job_read(fd, &result, sizeof(result)) != 0) {
+			puts("Error talking to daemon");
+			return EXIT_FAILURE;
+		}
+
+		if (result.status != 0) {
+			printf("Job failed: %s\n", strerror(result.status));
+			return EXIT_FAILURE;
+		}
+
+		job.rom_size = 0;
+	}
+
+	uint64_t elapsed = c8job_now() - begin;
+
+	close(fd);
+	c8job_print(&result);
+
+	if (repeat > 1) {
+		printf("%d jobs, %" PRIu64 " us per job\n", repeat, elapsed / repeat / 1000);
+	}
+
+	return 0;
+}
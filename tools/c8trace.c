@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2019, Ksenia Balistreri
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+/*
+ * Decodes, filters and diffs traces written by chipollotto -t.
+ *
+ * cc -Iinclude tools/c8trace.c src/cpu.c src/debug.c src/mem.c src/trace.c -lpthread -o c8trace
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "trace.h"
+#include "cpu.h"
+
+#define C8TRACE_DISASM_LENGTH 32
+#define C8TRACE_DIFF_CONTEXT 8
+
+typedef struct {
+	uint16_t pc_lo;
+	uint16_t pc_hi;
+	uint16_t opcode;
+	uint16_t opcode_mask;
+	uint16_t reg_mask;
+} c8trace_filter_t;
+
+static void usage() {
+	puts("Usage: c8trace dump [-p lo-hi] [-o opcode[/mask]] [-w regs] file");
+	puts("       c8trace diff [-c context] file_a file_b");
+	puts("  -p  only instructions with lo <= PC <= hi (hex)");
+	puts("  -o  only opcodes matching opcode under mask (hex), e.g. d000/f000");
+	puts("  -w  only instructions changing one of the registers in the hex mask");
+	puts("  -c  records of context shown before the first difference");
+}
+
+static FILE* c8trace_open(const char* path) {
+	c8_trace_header_t header;
+	FILE* f = fopen(path, "rb");
+
+	if (f == NULL) {
+		perror(path);
+		return NULL;
+	}
+
+	if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, C8_TRACE_MAGIC, sizeof(C8_TRACE_MAGIC)) != 0) {
+		fprintf(stderr, "%s: not a trace\n", path);
+		fclose(f);
+		return NULL;
+	}
+
+	if (header.version != C8_TRACE_VERSION || header.record_size != sizeof(c8_trace_record_t)) {
+		fprintf(stderr, "%s: unsupported trace version %d\n", path, header.version);
+		fclose(f);
+		return NULL;
+	}
+
+	return f;
+}
+
+static void c8trace_print(const char* prefix, const c8_trace_record_t* rec) {
+	char text[C8TRACE_DISASM_LENGTH];
+
+	c8_cpu_disasm(rec->opcode, text, C8TRACE_DISASM_LENGTH);
+	printf("%s%10u %03x %04x %-18s I=%03x SP=%x", prefix, rec->index, rec->pc, rec->opcode, text, rec->immediate, rec->stack_counter);
+
+	for (int i = 0; i < REGISTERS_COUNT; i++) {
+		if (rec->reg_mask & (1 << i)) {
+			printf(" V%X=%02x", i, rec->registers[i]);
+		}
+	}
+
+	if (rec->mem_len != 0) {
+		printf(" [%03x]=", rec->mem_addr);
+
+		for (int i = 0; i < rec->mem_len; i++) {
+			printf("%02x", rec->mem[i]);
+		}
+	}
+
+	putchar('\n');
+}
+
+static int c8trace_match(const c8trace_filter_t* filter, const c8_trace_record_t* rec) {
+	return rec->pc >= filter->pc_lo && rec->pc <= filter->pc_hi
+			&& (rec->opcode & filter->opcode_mask) == filter->opcode
+			&& (filter->reg_mask == 0 || (rec->reg_mask & filter->reg_mask) != 0);
+}
+
+static int c8trace_dump(int argc, char* argv[]) {
+	c8trace_filter_t filter = { 0, 0xffff, 0, 0, 0 };
+	c8_trace_record_t rec;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "p:o:w:")) != -1) {
+		switch (opt) {
+			case 'p':
+				if (sscanf(optarg, "%hx-%hx", &filter.pc_lo, &filter.pc_hi) != 2) {
+					usage();
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'o':
+				filter.opcode_mask = 0xffff;
+
+				if (sscanf(optarg, "%hx/%hx", &filter.opcode, &filter.opcode_mask) < 1) {
+					usage();
+					return EXIT_FAILURE;
+				}
+
+				filter.opcode &= filter.opcode_mask;
+				break;
+			case 'w':
+				filter.reg_mask = strtoul(optarg, NULL, 16);
+				break;
+			default:
+				usage();
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind >= argc) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	FILE* f = c8trace_open(argv[optind]);
+
+	if (f == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		if (c8trace_match(&filter, &rec)) {
+			c8trace_print("", &rec);
+		}
+	}
+
+	fclose(f);
+
+	return 0;
+}
+
+/*
+ * Records are compared on everything except their index, so traces
+ * recorded in ring mode can be diffed once aligned on a common record.
+ */
+static int c8trace_same(const c8_trace_record_t* a, const c8_trace_record_t* b) {
+	return a->pc == b->pc && a->opcode == b->opcode && a->immediate == b->immediate
+			&& a->stack_counter == b->stack_counter
+			&& memcmp(a->registers, b->registers, REGISTERS_COUNT) == 0
+			&& a->mem_len == b->mem_len && a->mem_addr == b->mem_addr
+			&& memcmp(a->mem, b->mem, a->mem_len) == 0;
+}
+
+/*
+ * A ring trace starts wherever its buffer last wrapped, so the trace that
+ * starts later is the reference: the other one skips to the same index,
+ * then on to the first record matching its head. Full traces start at
+ * the same index and are left alone.
+ */
+static size_t c8trace_align(FILE* fa, c8_trace_record_t* a, FILE* fb, c8_trace_record_t* b) {
+	FILE* f = a->index < b->index ? fa : fb;
+	c8_trace_record_t* rec = a->index < b->index ? a : b;
+	c8_trace_record_t* head = a->index < b->index ? b : a;
+
+	while (rec->index < head->index || !c8trace_same(rec, head)) {
+		if (fread(rec, sizeof(*rec), 1, f) != 1) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int c8trace_diff(int argc, char* argv[]) {
+	int context = C8TRACE_DIFF_CONTEXT;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:")) != -1) {
+		switch (opt) {
+			case 'c':
+				context = atoi(optarg);
+				break;
+			default:
+				usage();
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind + 2 > argc || context < 0) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	c8_trace_record_t* history = NULL;
+	c8_trace_record_t a, b;
+	uint64_t same = 0;
+	int result = EXIT_FAILURE;
+	FILE* fa = c8trace_open(argv[optind]);
+	FILE* fb = c8trace_open(argv[optind + 1]);
+
+	if (fa == NULL || fb == NULL) {
+		goto out;
+	}
+
+	history = calloc(context + 1, sizeof(c8_trace_record_t));
+
+	if (history == NULL) {
+		perror("c8trace");
+		goto out;
+	}
+
+	size_t ra = fread(&a, sizeof(a), 1, fa);
+	size_t rb = fread(&b, sizeof(b), 1, fb);
+
+	if (ra == 1 && rb == 1 && a.index != b.index) {
+		if (!c8trace_align(fa, &a, fb, &b)) {
+			puts("traces have no instruction in common");
+			result = 1;
+			goto out;
+		}
+
+		printf("traces aligned at instructions %u and %u\n", a.index, b.index);
+	}
+
+	for (;;) {
+		if (ra != 1 || rb != 1) {
+			if (ra != rb) {
+				printf("%s ends after %llu identical instructions\n", argv[optind + (ra == 1)], (unsigned long long) same);
+				result = 1;
+			} else {
+				printf("traces are identical (%llu instructions)\n", (unsigned long long) same);
+				result = 0;
+			}
+			break;
+		}
+
+		if (!c8trace_same(&a, &b)) {
+			uint64_t shown = same < (uint64_t) context ? same : (uint64_t) context;
+
+			printf("traces diverge after %llu identical instructions\n", (unsigned long long) same);
+
+			for (uint64_t i = same - shown; i < same; i++) {
+				c8trace_print("  ", &history[i % (context + 1)]);
+			}
+
+			c8trace_print("< ", &a);
+			c8trace_print("> ", &b);
+			result = 1;
+			break;
+		}
+
+		history[same % (context + 1)] = a;
+		same++;
+		ra = fread(&a, sizeof(a), 1, fa);
+		rb = fread(&b, sizeof(b), 1, fb);
+	}
+
+out:
+	free(history);
+
+	if (fa != NULL) {
+		fclose(fa);
+	}
+
+	if (fb != NULL) {
+		fclose(fb);
+	}
+
+	return result;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	if (strcmp(argv[1], "dump") == 0) {
+		return c8trace_dump(argc - 1, &argv[1]);
+	} else if (strcmp(argv[1], "diff") == 0) {
+		return c8trace_diff(argc - 1, &argv[1]);
+	}
+
+	usage();
+
+	return EXIT_FAILURE;
+}